@@ -0,0 +1,291 @@
+// Timings of the generator and solver hot paths. Every step runs from fixed seeds,
+//     so results compare between builds and releases.
+#include "../src/PuzzleGen.hpp"
+#include "../src/Random.hpp"
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+//Every heap allocation in the process, to report allocations per op
+static std::atomic<u64> allocs = 0;
+void* operator new(size_t sz)
+{
+	allocs.fetch_add(1, std::memory_order_relaxed);
+	if(void* p = std::malloc(sz ? sz : 1))
+		return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace PuzzleGen
+{
+	struct GenBench
+	{
+		typedef std::unique_ptr<PuzzleGrid> GridPtr;
+		static GridPtr blank()
+		{
+			return GridPtr(new PuzzleGrid());
+		}
+		static GridPtr copy(PuzzleGrid const& g)
+		{
+			return GridPtr(new PuzzleGrid(g));
+		}
+		static void populate(PuzzleGrid& g)
+		{
+			g.populate();
+		}
+		static bool solve(PuzzleGrid& g)
+		{
+			return g.solve(false);
+		}
+		static void killer_fill(PuzzleGrid& g)
+		{
+			g.killer_fill();
+		}
+		static void build(PuzzleGrid& g, Difficulty d)
+		{
+			g.build(d);
+		}
+	};
+}
+using namespace PuzzleGen;
+typedef GenBench::GridPtr GridPtr;
+typedef std::chrono::steady_clock Clock;
+
+static const u64 SEED = 0x5EED;
+static const u8 NUM_INPUTS = 64; //puzzles/grids the solver steps cycle through
+static char const* diff_names[NUM_DIFF] = {"easy","normal","hard","killer"};
+//Killer puzzles are cut down to these many givens, cages kept, so the solvers work through the cage logic
+static const u8 KILLER_GIVENS[] = {6, 12, 24};
+static const u8 NUM_KILLER_INPUTS = std::size(KILLER_GIVENS);
+//Steps that must never touch the heap once running; the bench fails if they do
+//    (matched by prefix, so the killer variants are covered too)
+static char const* alloc_free[] = {"populate","solve","is_unique/backtrack","is_unique/dlx","grade"};
+
+struct Result
+{
+	string name;
+	u32 iters;
+	double mean_ns, p50_ns, p99_ns, allocs;
+};
+
+//Runs 'op' 'iters' times, timing each call; 'setup' runs untimed before each one
+template<typename Setup, typename Op>
+static Result measure(string const& name, u32 iters, Setup setup, Op op)
+{
+	vector<double> ns(iters);
+	u64 alloc_count = 0;
+	for(u32 q = 0; q < iters; ++q)
+	{
+		setup(q);
+		u64 start_allocs = allocs.load(std::memory_order_relaxed);
+		Clock::time_point start = Clock::now();
+		op(q);
+		Clock::time_point end = Clock::now();
+		alloc_count += allocs.load(std::memory_order_relaxed) - start_allocs;
+		ns[q] = std::chrono::duration<double,std::nano>(end - start).count();
+	}
+	double total = 0;
+	for(double v : ns)
+		total += v;
+	std::sort(ns.begin(), ns.end());
+	auto pct = [&ns](double p)
+		{
+			size_t rank = size_t(std::ceil(p * ns.size()));
+			return ns[rank ? rank-1 : 0];
+		};
+	Result r{name, iters, total / iters, pct(0.50), pct(0.99), double(alloc_count) / iters};
+	std::cout << format("{:<28} {:>7} {:>14.0f} {:>14.0f} {:>14.0f} {:>10.2f}",
+		r.name, r.iters, r.mean_ns, r.p50_ns, r.p99_ns, r.allocs) << std::endl;
+	return r;
+}
+static void no_setup(u32)
+{}
+//Keeps 'count' of the puzzle's cells as givens, picked from the seed, and blanks the rest
+static void keep_givens(PuzzleGrid& g, u8 count, u64 seed)
+{
+	u8 order[9*9];
+	for(u8 q = 0; q < 9*9; ++q)
+		order[q] = q;
+	Xoshiro256 rng(seed);
+	for(u8 q = 9*9-1; q > 0; --q)
+		std::swap(order[q], order[rng.below(q+1)]);
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		PuzzleCell& cell = g.cells[order[q]];
+		cell.given = q < count;
+		cell.val = cell.given ? cell.sol : 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	double scale = 1;
+	string json_file;
+	for(int q = 1; q < argc; ++q)
+	{
+		string arg = argv[q];
+		if(arg == "--scale" && q+1 < argc)
+			scale = std::stod(argv[++q]);
+		else if(arg == "--json" && q+1 < argc)
+			json_file = argv[++q];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--scale MULT] [--json FILE]" << std::endl;
+			return 1;
+		}
+	}
+	auto iters = [scale](u32 base)
+		{
+			return std::max(u32(1), u32(base * scale));
+		};
+	
+	//Fixed inputs for the steps that start from a finished grid or puzzle
+	vector<GridPtr> filled, hard, killer[NUM_KILLER_INPUTS];
+	for(u8 q = 0; q < NUM_INPUTS; ++q)
+	{
+		seed_thread_rng(SEED + q);
+		filled.push_back(GenBench::blank());
+		GenBench::populate(*filled.back());
+		hard.emplace_back(new PuzzleGrid(build_puzzle(DIFF_HARD, SEED + q)));
+		PuzzleGrid caged(build_puzzle(DIFF_KILLER, SEED + q));
+		for(u8 k = 0; k < NUM_KILLER_INPUTS; ++k)
+		{
+			killer[k].push_back(GenBench::copy(caged));
+			keep_givens(*killer[k].back(), KILLER_GIVENS[k], SEED + q);
+		}
+	}
+	
+	std::cout << format("{:<28} {:>7} {:>14} {:>14} {:>14} {:>10}",
+		"benchmark", "iters", "ns/op", "p50 ns", "p99 ns", "allocs/op") << std::endl;
+	vector<Result> results;
+	GridPtr grid;
+	results.push_back(measure("populate", iters(2000),
+		[&grid](u32 q)
+		{
+			seed_thread_rng(SEED + q);
+			grid = GenBench::blank();
+		},
+		[&grid](u32)
+		{
+			GenBench::populate(*grid);
+		}));
+	results.push_back(measure("solve", iters(2000),
+		[&grid, &hard](u32 q)
+		{
+			seed_thread_rng(SEED + q);
+			grid = GenBench::copy(*hard[q % NUM_INPUTS]);
+		},
+		[&grid](u32)
+		{
+			GenBench::solve(*grid);
+		}));
+	for(u8 k = 0; k < NUM_KILLER_INPUTS; ++k)
+		results.push_back(measure(format("solve/killer{}", KILLER_GIVENS[k]), iters(200),
+			[&grid, &killer, k](u32 q)
+			{
+				seed_thread_rng(SEED + q);
+				grid = GenBench::copy(*killer[k][q % NUM_INPUTS]);
+			},
+			[&grid](u32)
+			{
+				GenBench::solve(*grid);
+			}));
+	for(u8 s = 0; s < NUM_SOLVERS; ++s)
+	{
+		set_solver(SolverBackend(s));
+		string name = s == SOLVER_DLX ? "is_unique/dlx" : "is_unique/backtrack";
+		results.push_back(measure(name, iters(2000),
+			no_setup,
+			[&hard](u32 q)
+			{
+				hard[q % NUM_INPUTS]->is_unique();
+			}));
+		for(u8 k = 0; k < NUM_KILLER_INPUTS; ++k)
+			results.push_back(measure(format("{}/killer{}", name, KILLER_GIVENS[k]), iters(200),
+				no_setup,
+				[&killer, k](u32 q)
+				{
+					killer[k][q % NUM_INPUTS]->is_unique();
+				}));
+	}
+	set_solver(SOLVER_BACKTRACK);
+	results.push_back(measure("grade", iters(2000),
+		no_setup,
+		[&hard](u32 q)
+		{
+			hard[q % NUM_INPUTS]->grade();
+		}));
+	results.push_back(measure("killer_fill", iters(5000),
+		[&grid, &filled](u32 q)
+		{
+			seed_thread_rng(SEED + q);
+			grid = GenBench::copy(*filled[q % NUM_INPUTS]);
+		},
+		[&grid](u32)
+		{
+			GenBench::killer_fill(*grid);
+		}));
+	//Same steps as 'build_puzzle', so each build is one the game could really make
+	static const u32 build_iters[NUM_DIFF] = {1000, 1000, 200, 200};
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		results.push_back(measure(format("build/{}", diff_names[d]), iters(build_iters[d]),
+			[&grid](u32 q)
+			{
+				seed_thread_rng(SEED + q);
+				grid = GenBench::blank();
+				GenBench::populate(*grid);
+			},
+			[&grid, d](u32)
+			{
+				GenBench::build(*grid, Difficulty(d));
+			}));
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		results.push_back(measure(format("construct/{}", diff_names[d]), iters(build_iters[d]),
+			[](u32 q)
+			{
+				seed_thread_rng(SEED + q);
+			},
+			[d](u32)
+			{
+				PuzzleGrid g{Difficulty(d)};
+			}));
+	
+	int ret = 0;
+	for(Result const& r : results)
+		for(char const* name : alloc_free)
+			if(r.name.starts_with(name) && r.allocs > 0)
+			{
+				std::cerr << format("'{}' allocated {:.2f} times per op; it must not allocate", r.name, r.allocs) << std::endl;
+				ret = 1;
+			}
+	
+	if(json_file.empty())
+		return ret;
+	std::ofstream file(json_file, std::ios::trunc);
+	file << "{\"seed\":" << SEED << ",\"benchmarks\":[";
+	for(size_t q = 0; q < results.size(); ++q)
+	{
+		Result const& r = results[q];
+		file << (q ? "," : "") << format("\n{{\"name\":\"{}\",\"iters\":{},\"ns_per_op\":{:.1f},"
+			"\"p50_ns\":{:.1f},\"p99_ns\":{:.1f},\"allocs_per_op\":{:.3f}}}",
+			r.name, r.iters, r.mean_ns, r.p50_ns, r.p99_ns, r.allocs);
+	}
+	file << "\n]}\n";
+	if(!file)
+	{
+		std::cerr << "Failed to write '" << json_file << "'" << std::endl;
+		return 1;
+	}
+	return ret;
+}
@@ -0,0 +1,54 @@
+// Throughput of PuzzleSimd's candidate elimination kernel at each supported level
+#include "../src/PuzzleSimd.hpp"
+#include <cstring>
+
+using namespace PuzzleSimd;
+
+int main(int argc, char** argv)
+{
+	u64 iters = argc > 1 ? std::stoull(argv[1]) : 10000000;
+	//A fixed set of unit masks, so every level does identical work
+	std::mt19937 gen(12345);
+	static const u8 NUM_SETS = 64;
+	u16 unit_vals[NUM_SETS][27];
+	for(auto& set : unit_vals)
+		for(u16& v : set)
+			v = gen() & 0x1FF;
+	
+	u16 expected[NUM_SETS][81];
+	for(u8 q = 0; q < NUM_SETS; ++q)
+		eliminate(SIMD_SCALAR, unit_vals[q], expected[q]);
+	
+	std::cout << "Best supported: " << simd_name(simd_level()) << std::endl;
+	double scalar_ns = 0;
+	for(u8 lvl = 0; lvl <= simd_level(); ++lvl)
+	{
+		u16 opts[81];
+		u64 checksum = 0;
+		for(u8 q = 0; q < NUM_SETS; ++q)
+		{
+			eliminate(SimdLevel(lvl), unit_vals[q], opts);
+			if(memcmp(opts, expected[q], sizeof(opts)))
+			{
+				std::cout << simd_name(SimdLevel(lvl)) << ": MISMATCH vs scalar" << std::endl;
+				return 1;
+			}
+		}
+		auto start = std::chrono::steady_clock::now();
+		for(u64 q = 0; q < iters; ++q)
+		{
+			eliminate(SimdLevel(lvl), unit_vals[q % NUM_SETS], opts);
+			checksum += opts[q % 81];
+		}
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double,std::nano>(end-start).count() / iters;
+		if(!lvl)
+			scalar_ns = ns;
+		std::cout << std::setw(7) << simd_name(SimdLevel(lvl)) << ": "
+			<< std::fixed << std::setprecision(2) << ns << " ns/grid, "
+			<< (81.0 / ns) * 1000.0 << " Mcells/s, "
+			<< scalar_ns / ns << "x scalar"
+			<< " (checksum " << checksum << ")" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Types.hpp"
+
+// Byte-level helpers shared by the generator's binary files (the puzzle cache and bank)
+namespace ByteIO
+{
+	// FNV-1a
+	inline u64 checksum(u8 const* data, size_t len)
+	{
+		u64 hash = 0xCBF29CE484222325ULL;
+		for(size_t q = 0; q < len; ++q)
+			hash = (hash ^ data[q]) * 0x100000001B3ULL;
+		return hash;
+	}
+	// Integers are stored little-endian, in as many bytes as their field needs
+	inline void put_le(u8* dest, u64 val, u8 bytes)
+	{
+		for(u8 q = 0; q < bytes; ++q)
+			dest[q] = u8(val >> (8*q));
+	}
+	inline u64 get_le(u8 const* src, u8 bytes)
+	{
+		u64 val = 0;
+		for(u8 q = 0; q < bytes; ++q)
+			val |= u64(src[q]) << (8*q);
+		return val;
+	}
+}
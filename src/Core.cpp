@@ -0,0 +1,50 @@
+#include "Core.hpp"
+
+bool verbose_log = false;
+
+string build_ccode(CCFG fg, CCBG bg)
+{
+	stringstream s;
+	s << "\x1B[";
+	if(bg != LOG_BG_NONE)
+		s << bg << ';';
+	s << fg << "m";
+	return s.str();
+}
+string default_ccode = build_ccode(LOG_FG_B_PURPLE,LOG_BG_NONE);
+void log(string const& hdr, string const& msg, bool is_verbose)
+{
+	if(verbose_log || !is_verbose)
+		std::cout << default_ccode << "[LOG][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
+}
+void clog(string const& hdr, string const& msg, string const& ccode, bool is_verbose)
+{
+	if(verbose_log || !is_verbose)
+		std::cout << ccode << "[LOG][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
+}
+void error(string const& hdr, string const& msg, bool is_verbose)
+{
+	if(verbose_log || !is_verbose)
+		std::cerr << build_ccode(LOG_FG_RED) << "[ERROR][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
+}
+void fail(string const& hdr, string const& msg)
+{
+	std::cerr << build_ccode(LOG_FG_RED) << "[FATAL][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
+	exit(1);
+}
+void log(string const& msg, bool is_verbose)
+{
+	log("APSudoku", msg, is_verbose);
+}
+void clog(string const& msg, string const& ccode, bool is_verbose)
+{
+	clog("APSudoku", msg, ccode, is_verbose);
+}
+void error(string const& msg, bool is_verbose)
+{
+	error("APSudoku", msg, is_verbose);
+}
+void fail(string const& msg)
+{
+	fail("APSudoku", msg);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Types.hpp"
+#include <array>
+#include <bit>
+#include <span>
+
+// Compile-time lookup tables for the 9x9 grid, shared by the generator, checker and renderer
+namespace GridTables
+{
+	#define NO_CELL 0xFF
+	#define NO_CAGE 0xFF //cage id of an uncaged cell
+
+	constexpr u8 row_of(u8 index) {return index/9;}
+	constexpr u8 col_of(u8 index) {return index%9;}
+	constexpr u8 box_of(u8 index) {return 3*(row_of(index)/3) + (col_of(index)/3);}
+
+	// The 27 units: rows 0-8, columns 9-17, boxes 18-26
+	enum
+	{
+		UNIT_ROW = 0,
+		UNIT_COL = 9,
+		UNIT_BOX = 18,
+		NUM_UNITS = 27
+	};
+	inline constexpr auto units = []()
+		{
+			std::array<std::array<u8,9>,NUM_UNITS> ret{};
+			for(u8 u = 0; u < 9; ++u)
+				for(u8 q = 0; q < 9; ++q)
+				{
+					ret[UNIT_ROW+u][q] = 9*u + q;
+					ret[UNIT_COL+u][q] = 9*q + u;
+					ret[UNIT_BOX+u][q] = 9*(3*(u/3) + (q/3)) + (3*(u%3) + (q%3));
+				}
+			return ret;
+		}();
+
+	// The row, column and box unit of each cell
+	inline constexpr auto cell_units = []()
+		{
+			std::array<std::array<u8,3>,9*9> ret{};
+			for(u8 index = 0; index < 9*9; ++index)
+				ret[index] = {u8(UNIT_ROW+row_of(index)), u8(UNIT_COL+col_of(index)), u8(UNIT_BOX+box_of(index))};
+			return ret;
+		}();
+
+	// The 20 cells that 'see' each cell (share a row, column or box)
+	inline constexpr auto peers = []()
+		{
+			std::array<std::array<u8,20>,9*9> ret{};
+			for(u8 index = 0; index < 9*9; ++index)
+			{
+				u8 n = 0;
+				for(u8 q = 0; q < 9*9; ++q)
+				{
+					if(q == index)
+						continue;
+					if(row_of(q) == row_of(index) || col_of(q) == col_of(index)
+						|| box_of(q) == box_of(index))
+						ret[index][n++] = q;
+				}
+			}
+			return ret;
+		}();
+
+	// The orthogonally adjacent cells, indexed by DIR_UP/DIR_DOWN/DIR_LEFT/DIR_RIGHT
+	//     NO_CELL past the edge of the grid
+	inline constexpr auto adjacent = []()
+		{
+			std::array<std::array<u8,4>,9*9> ret{};
+			for(u8 index = 0; index < 9*9; ++index)
+			{
+				u8 row = row_of(index), col = col_of(index);
+				ret[index] = {
+					u8(row > 0 ? index-9 : NO_CELL),
+					u8(row < 8 ? index+9 : NO_CELL),
+					u8(col > 0 ? index-1 : NO_CELL),
+					u8(col < 8 ? index+1 : NO_CELL)
+				};
+			}
+			return ret;
+		}();
+	
+	// Every set of distinct digits 1-9 (as a mask, bit (v-1) for 'v'),
+	//     sorted by how many digits it has, then by their sum
+	constexpr u8 combo_sum(u16 combo)
+	{
+		u8 sum = 0;
+		for(u8 v = 1; v <= 9; ++v)
+			if(combo & (1 << (v-1)))
+				sum += v;
+		return sum;
+	}
+	constexpr u16 combo_key(u8 size, u8 sum) {return size*46 + sum;}
+	inline constexpr auto cage_combo_start = []()
+		{
+			//cage_combos[cage_combo_start[key]] is the first combo for a key
+			std::array<u16,combo_key(9,45)+2> ret{};
+			for(u16 combo = 0; combo < 512; ++combo)
+				++ret[combo_key(std::popcount(combo), combo_sum(combo))+1];
+			for(u16 q = 1; q < ret.size(); ++q)
+				ret[q] += ret[q-1];
+			return ret;
+		}();
+	inline constexpr auto cage_combos = []()
+		{
+			std::array<u16,512> ret{};
+			auto next = cage_combo_start;
+			for(u16 combo = 0; combo < 512; ++combo)
+				ret[next[combo_key(std::popcount(combo), combo_sum(combo))]++] = combo;
+			return ret;
+		}();
+	// The digit sets that can fill 'size' cells of a cage summing to 'sum'
+	constexpr std::span<u16 const> cage_combos_for(u8 size, u8 sum)
+	{
+		if(size > 9 || sum > 45)
+			return {};
+		u16 key = combo_key(size, sum);
+		return std::span<u16 const>(cage_combos.begin() + cage_combo_start[key],
+			cage_combos.begin() + cage_combo_start[key+1]);
+	}
+}
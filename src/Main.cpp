@@ -8,53 +8,6 @@
 #include "Network.hpp"
 #include "PuzzleGen.hpp"
 
-string build_ccode(CCFG fg, CCBG bg)
-{
-	stringstream s;
-	s << "\x1B[";
-	if(bg != LOG_BG_NONE)
-		s << bg << ';';
-	s << fg << "m";
-	return s.str();
-}
-string default_ccode = build_ccode(LOG_FG_B_PURPLE,LOG_BG_NONE);
-void log(string const& hdr, string const& msg, bool is_verbose)
-{
-	if(verbose_log || !is_verbose)
-		std::cout << default_ccode << "[LOG][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
-}
-void clog(string const& hdr, string const& msg, string const& ccode, bool is_verbose)
-{
-	if(verbose_log || !is_verbose)
-		std::cout << ccode << "[LOG][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
-}
-void error(string const& hdr, string const& msg, bool is_verbose)
-{
-	if(verbose_log || !is_verbose)
-		std::cerr << build_ccode(LOG_FG_RED) << "[ERROR][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
-}
-void fail(string const& hdr, string const& msg)
-{
-	std::cerr << build_ccode(LOG_FG_RED) << "[FATAL][" << hdr << "] " << msg << CCODE_REVERT << std::endl;
-	exit(1);
-}
-void log(string const& msg, bool is_verbose)
-{
-	log("APSudoku", msg, is_verbose);
-}
-void clog(string const& msg, string const& ccode, bool is_verbose)
-{
-	clog("APSudoku", msg, ccode, is_verbose);
-}
-void error(string const& msg, bool is_verbose)
-{
-	error("APSudoku", msg, is_verbose);
-}
-void fail(string const& msg)
-{
-	fail("APSudoku", msg);
-}
-
 Hint::operator string() const
 {
 	auto flagstr = ap_get_itemflagstr(item_flags);
@@ -90,6 +43,7 @@ ALLEGRO_BITMAP* canvas;
 ALLEGRO_TIMER* timer;
 ALLEGRO_EVENT_QUEUE* events;
 ALLEGRO_EVENT_SOURCE event_source;
+#define EVENT_WAKE ALLEGRO_GET_EVENT_TYPE('A','P','S','W')
 
 std::mt19937 rng;
 bool shift_center = false;
@@ -1041,7 +995,7 @@ void setup_allegro();
 void save_cfg();
 volatile bool program_running = true;
 u64 cur_frame = 0;
-bool shape_mode = false, thicker_borders = false, show_invalid = false, verbose_log = false;
+bool shape_mode = false, thicker_borders = false, show_invalid = false;
 void run_events(bool& redraw)
 {
 	ALLEGRO_EVENT ev;
@@ -1088,6 +1042,13 @@ bool events_empty()
 {
 	return al_is_event_queue_empty(events);
 }
+//Wakes the main thread out of 'run_events', so it re-checks whatever it is waiting on
+void wake_events()
+{
+	ALLEGRO_EVENT ev;
+	ev.user.type = EVENT_WAKE;
+	al_emit_user_event(&event_source, &ev, nullptr);
+}
 int main(int argc, char **argv)
 {
 	try
@@ -1099,6 +1060,7 @@ int main(int argc, char **argv)
 			wdir = "";
 		else wdir = exepath.substr(0,1+ind);
 		std::filesystem::current_path(wdir);
+		PuzzleGen::set_data_dir(std::filesystem::current_path().string()); //stays put if the working dir changes
 		log("Running in dir: \"" + wdir + "\"");
 		//
 		setup_allegro();
@@ -1109,6 +1071,10 @@ int main(int argc, char **argv)
 		build_gui();
 		init_grid();
 		log("...built!", true);
+		PuzzleGen::set_on_ready([](Difficulty)
+			{
+				wake_events(); //let a waiting popup see it straight away
+			});
 		PuzzleGen::init();
 		
 		InputState input_state;
@@ -1133,7 +1099,9 @@ int main(int argc, char **argv)
 		return 0;
 	}
 	catch(ignore_exception&)
-	{}
+	{
+		PuzzleGen::shutdown(); //closed while waiting on a puzzle
+	}
 	catch(sudoku_exception& e)
 	{
 		fail(format("Sudoku Error: {}",e.what()));
@@ -1210,6 +1178,20 @@ void default_configs() // Resets configs to default
 	add_config_comment("Sudoku", "When 'Check'ing an invalid solution, highlight the errors");
 	set_config_bool("Sudoku", "show_invalid", false);
 	
+	add_config_section("PuzzleGen");
+	add_config_comment("PuzzleGen", "Solver used to check puzzles are unique while generating ('backtrack' or 'dlx')");
+	set_config_str("PuzzleGen", "solver", "backtrack");
+	add_config_comment("PuzzleGen", "Seed for puzzle generation, to reproduce a run (0 picks a new seed each launch)");
+	set_config_str("PuzzleGen", "seed", "0");
+	add_config_comment("PuzzleGen", "Threads generating puzzles in the background (0 uses one per CPU thread)");
+	set_config_int("PuzzleGen", "threads", 0);
+	add_config_comment("PuzzleGen", "Largest acceptable chance of waiting for a new puzzle (sizes the ready queues)");
+	set_config_dbl("PuzzleGen", "wait_chance", 0.01);
+	add_config_comment("PuzzleGen", "Fraction of those threads' time background generation may use, on average");
+	set_config_dbl("PuzzleGen", "cpu_budget", 0.75);
+	add_config_comment("PuzzleGen", "A pre-generated puzzle bank file to serve from, instead of generating (blank for none)");
+	set_config_str("PuzzleGen", "bank", "");
+	
 	Theme::reset();
 }
 void refresh_configs() // Uses values in the loaded configs to change the program
@@ -1252,6 +1234,20 @@ void refresh_configs() // Uses values in the loaded configs to change the progra
 	BOOL_READ(thicker_borders, "GUI", "thicker_borders")
 	BOOL_READ(show_invalid, "Sudoku", "show_invalid")
 	BOOL_READ(verbose_log, "GUI", "verbose_log")
+	if(auto val = get_config_str("PuzzleGen", "solver"))
+		PuzzleGen::set_solver(*val == "dlx" ? PuzzleGen::SOLVER_DLX : PuzzleGen::SOLVER_BACKTRACK);
+	if(auto val = get_config_str("PuzzleGen", "seed"))
+		PuzzleGen::set_seed(strtoull(val->c_str(), nullptr, 10));
+	int gen_threads = 0;
+	INT_BOUND(gen_threads,0,256,"PuzzleGen","threads")
+	PuzzleGen::set_threads(gen_threads);
+	double gen_wait_chance = 0.01, gen_cpu_budget = 0.75;
+	DBL_BOUND(gen_wait_chance,0.0001,0.5,"PuzzleGen","wait_chance")
+	DBL_BOUND(gen_cpu_budget,0.05,1.0,"PuzzleGen","cpu_budget")
+	PuzzleGen::set_wait_chance(gen_wait_chance);
+	PuzzleGen::set_cpu_budget(gen_cpu_budget);
+	if(auto val = get_config_str("PuzzleGen", "bank"))
+		PuzzleGen::set_bank(*val);
 	
 	if(wrote_any)
 		save_cfg();
@@ -0,0 +1,518 @@
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+#include "PuzzleGen.hpp"
+#include "GridTables.hpp"
+#include "ByteIO.hpp"
+#include "Random.hpp"
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+#include <cstring>
+
+namespace PuzzleGen
+{
+using namespace GridTables;
+using namespace ByteIO;
+
+// A bank is a read-only file of pre-generated puzzles, mapped into memory:
+//     header: "APSB", u16 version, u16 record size, u16 band count, u16 (unused),
+//         then for each difficulty and rating band: u64 first record, u64 record count,
+//         u16 lowest rating; then a u64 checksum of everything before it
+//     records: fixed-size, sorted by difficulty then rating
+// Each difficulty's records are split into bands of equal size by rating.
+// Which records were served is kept outside the bank, so the bank can stay read-only.
+#define BANK_STATE_FILE "APSudoku.bank-state" //in the data dir, beside the puzzle cache
+#define STATE_SAVE_DRAWS 32 //draws between saves of the served state; it's also saved on close
+static const char BANK_MAGIC[4] = {'A','P','S','B'};
+static const char STATE_MAGIC[4] = {'A','P','S','S'};
+static const u16 BANK_VERSION = 1;
+static const u8 BANK_BANDS = 8;
+static const size_t BAND_SIZE = 8+8+2;
+static const size_t BANK_HEADER_SIZE = 12 + NUM_DIFF*BANK_BANDS*BAND_SIZE + 8;
+
+struct BankRecord
+{
+	u8 packed_sol[(9*9+1)/2]; //as BuiltPuzzle
+	u8 givens[11]; //81 bits, cell 0 in the lowest bit
+	u8 joins[18]; //killer cages: bit set where two adjacent cells share a cage
+	u8 rating[2];
+	u8 seed[8];
+};
+static_assert(sizeof(BankRecord) == 80);
+
+//Joins are numbered: 0-71 for each cell and the one to its right, 72-143 for the one below
+static optional<u8> join_index(u8 index, u8 dir)
+{
+	u8 row = row_of(index), col = col_of(index);
+	if(dir == DIR_RIGHT && col < 8)
+		return 8*row + col;
+	if(dir == DIR_DOWN && row < 8)
+		return 72 + 9*row + col;
+	return nullopt;
+}
+static bool get_bit(u8 const* bits, u8 ind)
+{
+	return (bits[ind/8] >> (ind%8)) & 1;
+}
+static void set_bit(u8* bits, u8 ind)
+{
+	bits[ind/8] |= 1 << (ind%8);
+}
+
+static BankRecord encode(BuiltPuzzle const& puz, u16 rating)
+{
+	BankRecord rec{};
+	memcpy(rec.packed_sol, puz.packed_sol, sizeof(rec.packed_sol));
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		if(puz.given(q))
+			set_bit(rec.givens, q);
+		if(puz.cage_of[q] == NO_CAGE)
+			continue;
+		for(u8 dir : {DIR_RIGHT, DIR_DOWN})
+			if(auto j = join_index(q, dir))
+				if(puz.cage_of[adjacent[q][dir]] == puz.cage_of[q])
+					set_bit(rec.joins, *j);
+	}
+	put_le(rec.rating, rating, 2);
+	put_le(rec.seed, puz.seed, 8);
+	return rec;
+}
+static optional<BuiltPuzzle> decode(BankRecord const& rec, Difficulty d)
+{
+	BuiltPuzzle puz{};
+	puz.seed = get_le(rec.seed, 8);
+	puz.iso_seed = 0;
+	puz.diff = d;
+	memcpy(puz.packed_sol, rec.packed_sol, sizeof(puz.packed_sol));
+	memset(puz.cage_of, NO_CAGE, sizeof(puz.cage_of));
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		u8 v = puz.solution(q);
+		if(v < 1 || v > 9)
+			return nullopt;
+		if(get_bit(rec.givens, q))
+			puz.givens.insert(q);
+	}
+	if(d != DIFF_KILLER)
+		return puz;
+	//Every killer cell is caged; flood-fill the joins back into cages
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		if(puz.cage_of[q] != NO_CAGE)
+			continue;
+		u8 id = puz.num_cages++;
+		u8 stack[9*9];
+		u8 sz = 0;
+		stack[sz++] = q;
+		puz.cage_of[q] = id;
+		puz.cage_sums[id] = 0;
+		while(sz)
+		{
+			u8 cell = stack[--sz];
+			puz.cage_sums[id] += puz.solution(cell);
+			for(u8 dir = DIR_UP; dir <= DIR_RIGHT; ++dir)
+			{
+				u8 adj = adjacent[cell][dir];
+				if(adj == NO_CELL || puz.cage_of[adj] != NO_CAGE)
+					continue;
+				//a join is stored once, from the upper/left cell
+				optional<u8> j = (dir == DIR_UP || dir == DIR_LEFT)
+					? join_index(adj, dir == DIR_UP ? DIR_DOWN : DIR_RIGHT)
+					: join_index(cell, dir);
+				if(j && get_bit(rec.joins, *j))
+				{
+					puz.cage_of[adj] = id;
+					stack[sz++] = adj;
+				}
+			}
+		}
+	}
+	return puz;
+}
+
+//A keyed bijection on [0,n), so a bare counter walks a range in random order without repeats.
+//    A 4-round Feistel network over the next even power of two, cycle-walking back into range.
+static u64 permute(u64 i, u64 n, u64 key)
+{
+	u8 bits = std::bit_width(n-1);
+	if(bits < 2)
+		bits = 2;
+	bits += bits%2;
+	u8 half = bits/2;
+	u64 mask = (1ULL << half) - 1;
+	do
+	{
+		u64 l = i >> half, r = i & mask;
+		for(u8 round = 0; round < 4; ++round)
+		{
+			u64 state = key + round + (r << 8);
+			u64 t = l ^ (splitmix64(state) & mask);
+			l = r;
+			r = t;
+		}
+		i = (l << half) | r;
+	}
+	while(i >= n);
+	return i;
+}
+
+struct MappedFile
+{
+	u8 const* data = nullptr;
+	size_t size = 0;
+	
+	bool open(string const& fname);
+	void close();
+	~MappedFile() {close();}
+private:
+	#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+	#else
+	int fd = -1;
+	#endif
+};
+#ifdef _WIN32
+bool MappedFile::open(string const& fname)
+{
+	close();
+	file = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER sz;
+	if(!GetFileSizeEx(file, &sz) || !sz.QuadPart)
+	{
+		close();
+		return false;
+	}
+	size = size_t(sz.QuadPart);
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mapping)
+		data = (u8 const*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if(!data)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+void MappedFile::close()
+{
+	if(data)
+		UnmapViewOfFile(data);
+	if(mapping)
+		CloseHandle(mapping);
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(string const& fname)
+{
+	close();
+	fd = ::open(fname.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd, &st) || !st.st_size)
+	{
+		close();
+		return false;
+	}
+	size = size_t(st.st_size);
+	void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	if(ptr == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	data = (u8 const*)ptr;
+	madvise(ptr, size, MADV_RANDOM); //draws jump around the whole file
+	return true;
+}
+void MappedFile::close()
+{
+	if(data)
+		munmap((void*)data, size);
+	if(fd >= 0)
+		::close(fd);
+	data = nullptr;
+	size = 0;
+	fd = -1;
+}
+#endif
+
+struct BankBand
+{
+	u64 first, count;
+	u16 min_rating;
+};
+struct PuzzleBank
+{
+	bool open(string const& fname);
+	void close();
+	bool has(Difficulty d) const;
+	optional<BuiltPuzzle> draw(Difficulty d, u16 min_rating, u16 max_rating);
+private:
+	MappedFile file;
+	BankRecord const* records = nullptr;
+	u64 num_records = 0;
+	u64 bank_id = 0;
+	BankBand bands[NUM_DIFF][BANK_BANDS];
+	//Served state: each band is walked in the order 'permute' gives, from its cursor
+	u64 keys[NUM_DIFF][BANK_BANDS];
+	u64 cursors[NUM_DIFF][BANK_BANDS];
+	u8 unsaved_draws = 0;
+	Xoshiro256 rng;
+	std::mutex mut;
+	
+	void new_pass(u8 d, u8 b);
+	void load_state();
+	void save_state();
+};
+static PuzzleBank bank;
+
+bool PuzzleBank::open(string const& fname)
+{
+	close();
+	if(!file.open(fname))
+	{
+		error(format("Failed to open puzzle bank '{}'", fname));
+		return false;
+	}
+	u8 const* data = file.data;
+	if(file.size < BANK_HEADER_SIZE || memcmp(data, BANK_MAGIC, 4)
+		|| get_le(data+4, 2) != BANK_VERSION || get_le(data+6, 2) != sizeof(BankRecord)
+		|| get_le(data+8, 2) != BANK_BANDS
+		|| get_le(data+BANK_HEADER_SIZE-8, 8) != checksum(data, BANK_HEADER_SIZE-8))
+	{
+		error(format("'{}' is not a valid puzzle bank", fname));
+		close();
+		return false;
+	}
+	bank_id = get_le(data+BANK_HEADER_SIZE-8, 8);
+	records = (BankRecord const*)(data + BANK_HEADER_SIZE);
+	num_records = (file.size - BANK_HEADER_SIZE) / sizeof(BankRecord);
+	u8 const* ptr = data+12;
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		for(BankBand& band : bands[d])
+		{
+			band.first = get_le(ptr, 8);
+			band.count = get_le(ptr+8, 8);
+			band.min_rating = get_le(ptr+16, 2);
+			ptr += BAND_SIZE;
+			if(band.first > num_records || band.count > num_records - band.first)
+			{
+				error(format("Puzzle bank '{}' is truncated", fname));
+				close();
+				return false;
+			}
+		}
+	rng.reseed(get_seed());
+	load_state();
+	log(format("Opened puzzle bank '{}' ({} puzzles)", fname, num_records), true);
+	return true;
+}
+void PuzzleBank::close()
+{
+	std::lock_guard lk(mut);
+	if(records && unsaved_draws)
+		save_state();
+	file.close();
+	records = nullptr;
+	num_records = 0;
+	memset(bands, 0, sizeof(bands));
+}
+bool PuzzleBank::has(Difficulty d) const
+{
+	if(!records)
+		return false;
+	for(BankBand const& band : bands[d])
+		if(band.count)
+			return true;
+	return false;
+}
+void PuzzleBank::new_pass(u8 d, u8 b)
+{
+	keys[d][b] = rng();
+	cursors[d][b] = 0;
+}
+//Draws a random record not served since its band was last exhausted.
+//    Rating limits select whole bands, so they are only as fine as the bands.
+optional<BuiltPuzzle> PuzzleBank::draw(Difficulty d, u16 min_rating, u16 max_rating)
+{
+	std::lock_guard lk(mut);
+	if(!records)
+		return nullopt;
+	auto usable = [&](u8 b)
+		{
+			BankBand const& band = bands[d][b];
+			//A band's ratings stop short of where the next non-empty band's start
+			u32 next_min = 0x10000;
+			for(u8 n = b+1; n < BANK_BANDS; ++n)
+				if(bands[d][n].count)
+				{
+					next_min = bands[d][n].min_rating;
+					break;
+				}
+			return band.count && band.min_rating <= max_rating && next_min > min_rating;
+		};
+	for(u8 pass = 0; pass < 2; ++pass)
+	{
+		u64 left = 0;
+		for(u8 b = 0; b < BANK_BANDS; ++b)
+			if(usable(b))
+				left += bands[d][b].count - cursors[d][b];
+		if(!left)
+		{
+			//Everything in range has been served, so start those bands over
+			for(u8 b = 0; b < BANK_BANDS; ++b)
+				if(usable(b))
+					new_pass(d, b);
+			continue;
+		}
+		//Weight bands by what they have left, so every unserved record is equally likely
+		u64 pick = rng.below(left);
+		for(u8 b = 0; b < BANK_BANDS; ++b)
+		{
+			if(!usable(b))
+				continue;
+			BankBand const& band = bands[d][b];
+			u64 band_left = band.count - cursors[d][b];
+			if(pick >= band_left)
+			{
+				pick -= band_left;
+				continue;
+			}
+			u64 ind = band.first + permute(cursors[d][b]++, band.count, keys[d][b]);
+			if(++unsaved_draws >= STATE_SAVE_DRAWS)
+				save_state();
+			return decode(records[ind], d);
+		}
+	}
+	return nullopt;
+}
+void PuzzleBank::load_state()
+{
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		for(u8 b = 0; b < BANK_BANDS; ++b)
+			new_pass(d, b);
+	unsaved_draws = 0;
+	std::ifstream f(data_path(BANK_STATE_FILE), std::ios::binary);
+	u8 buf[4 + 8 + NUM_DIFF*BANK_BANDS*(8+8)];
+	if(!f.read((char*)buf, sizeof(buf)) || memcmp(buf, STATE_MAGIC, 4)
+		|| get_le(buf+4, 8) != bank_id)
+		return; //no state for this bank
+	u8 const* ptr = buf+12;
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		for(u8 b = 0; b < BANK_BANDS; ++b, ptr += 16)
+		{
+			keys[d][b] = get_le(ptr, 8);
+			cursors[d][b] = std::min(get_le(ptr+8, 8), bands[d][b].count);
+		}
+}
+//Call with 'mut' held
+void PuzzleBank::save_state()
+{
+	u8 buf[4 + 8 + NUM_DIFF*BANK_BANDS*(8+8)];
+	memcpy(buf, STATE_MAGIC, 4);
+	put_le(buf+4, bank_id, 8);
+	u8* ptr = buf+12;
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		for(u8 b = 0; b < BANK_BANDS; ++b, ptr += 16)
+		{
+			put_le(ptr, keys[d][b], 8);
+			put_le(ptr+8, cursors[d][b], 8);
+		}
+	std::ofstream f(data_path(BANK_STATE_FILE), std::ios::binary | std::ios::trunc);
+	f.write((char const*)buf, sizeof(buf));
+	unsaved_draws = 0;
+}
+
+bool open_bank(string const& fname)
+{
+	return bank.open(fname);
+}
+void close_bank()
+{
+	bank.close();
+}
+bool bank_has(Difficulty d)
+{
+	return bank.has(d);
+}
+optional<BuiltPuzzle> draw_bank(Difficulty d, u16 min_rating, u16 max_rating)
+{
+	return bank.draw(d, min_rating, max_rating);
+}
+
+struct BankWriter::Entry
+{
+	u8 diff;
+	u16 rating;
+	BankRecord rec;
+};
+BankWriter::BankWriter() = default;
+BankWriter::~BankWriter() = default;
+void BankWriter::add(BuiltPuzzle const& puz)
+{
+	u32 effort = PuzzleGrid(puz).solve_effort();
+	u16 rating = effort > 0xFFFF ? 0xFFFF : effort;
+	entries.push_back({u8(puz.diff), rating, encode(puz, rating)});
+}
+bool BankWriter::write(string const& fname)
+{
+	std::stable_sort(entries.begin(), entries.end(), [](Entry const& a, Entry const& b)
+		{
+			return std::tie(a.diff, a.rating) < std::tie(b.diff, b.rating);
+		});
+	vector<u8> header(BANK_HEADER_SIZE);
+	memcpy(header.data(), BANK_MAGIC, 4);
+	put_le(&header[4], BANK_VERSION, 2);
+	put_le(&header[6], sizeof(BankRecord), 2);
+	put_le(&header[8], BANK_BANDS, 2);
+	u8* ptr = &header[12];
+	size_t start = 0;
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+	{
+		size_t end = start;
+		while(end < entries.size() && entries[end].diff == d)
+			++end;
+		//Bands of (nearly) equal size; never split one rating across two bands
+		size_t band_start = start;
+		for(u8 b = 0; b < BANK_BANDS; ++b, ptr += BAND_SIZE)
+		{
+			size_t band_end = (b+1 == BANK_BANDS) ? end : start + (end-start)*(b+1)/BANK_BANDS;
+			band_end = std::max(band_end, band_start);
+			while(band_end > band_start && band_end < end
+				&& entries[band_end].rating == entries[band_end-1].rating)
+				++band_end;
+			put_le(ptr, band_start, 8);
+			put_le(ptr+8, band_end - band_start, 8);
+			put_le(ptr+16, band_end > band_start ? entries[band_start].rating : 0xFFFF, 2);
+			band_start = band_end;
+		}
+		start = end;
+	}
+	put_le(&header[BANK_HEADER_SIZE-8], checksum(header.data(), BANK_HEADER_SIZE-8), 8);
+	
+	std::ofstream file(fname, std::ios::binary | std::ios::trunc);
+	file.write((char const*)header.data(), header.size());
+	for(Entry const& e : entries)
+		file.write((char const*)&e.rec, sizeof(e.rec));
+	return bool(file);
+}
+
+}
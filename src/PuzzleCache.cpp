@@ -0,0 +1,162 @@
+#include "PuzzleGen.hpp"
+#include "GridTables.hpp"
+#include "ByteIO.hpp"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+namespace PuzzleGen
+{
+using namespace ByteIO;
+
+// Unserved puzzles are kept between sessions in a small binary file:
+//     header: "APSQ", u16 version, u32 puzzle count, u32 payload size, u64 payload checksum
+//     payload: one record per puzzle, every integer little-endian
+// A file that fails any check is discarded whole.
+static const char CACHE_MAGIC[4] = {'A','P','S','Q'};
+static const u16 CACHE_VERSION = 1;
+static const size_t CACHE_HEADER_SIZE = 4+2+4+4+8;
+static const size_t CACHE_MIN_RECORD = 8+8+1+11+41+1; //a puzzle without cages
+
+static void put(vector<u8>& buf, u64 val, u8 bytes)
+{
+	size_t at = buf.size();
+	buf.resize(at + bytes);
+	put_le(&buf[at], val, bytes);
+}
+struct CacheReader
+{
+	u8 const* data;
+	size_t len, pos = 0;
+	bool bad = false;
+	
+	u64 get(u8 bytes)
+	{
+		if(len - pos < bytes)
+		{
+			bad = true;
+			return 0;
+		}
+		u64 val = get_le(data + pos, bytes);
+		pos += bytes;
+		return val;
+	}
+};
+
+static void write_record(vector<u8>& buf, BuiltPuzzle const& puz)
+{
+	put(buf, puz.seed, 8);
+	put(buf, puz.iso_seed, 8);
+	put(buf, puz.diff, 1);
+	put(buf, puz.givens.lo, 8);
+	put(buf, puz.givens.hi, 3);
+	buf.insert(buf.end(), std::begin(puz.packed_sol), std::end(puz.packed_sol));
+	put(buf, puz.num_cages, 1);
+	if(puz.num_cages) //only killer puzzles carry cages
+	{
+		buf.insert(buf.end(), std::begin(puz.cage_of), std::end(puz.cage_of));
+		buf.insert(buf.end(), puz.cage_sums, puz.cage_sums + puz.num_cages);
+	}
+}
+static bool read_record(CacheReader& rd, BuiltPuzzle& puz)
+{
+	puz = BuiltPuzzle{};
+	puz.seed = rd.get(8);
+	puz.iso_seed = rd.get(8);
+	u8 d = rd.get(1);
+	puz.givens.lo = rd.get(8);
+	puz.givens.hi = rd.get(3);
+	for(u8& b : puz.packed_sol)
+		b = rd.get(1);
+	puz.num_cages = rd.get(1);
+	memset(puz.cage_of, NO_CAGE, sizeof(puz.cage_of));
+	if(puz.num_cages)
+	{
+		for(u8& c : puz.cage_of)
+			c = rd.get(1);
+		for(u8 q = 0; q < puz.num_cages && q < 9*9; ++q)
+			puz.cage_sums[q] = rd.get(1);
+	}
+	if(rd.bad || d >= NUM_DIFF || puz.num_cages > 9*9
+		|| (puz.givens.hi >> (81-64)))
+		return false;
+	puz.diff = Difficulty(d);
+	for(u8 index = 0; index < 9*9; ++index)
+	{
+		u8 v = puz.solution(index);
+		if(v < 1 || v > 9)
+			return false;
+		u8 c = puz.cage_of[index];
+		if(c != NO_CAGE && c >= puz.num_cages)
+			return false;
+	}
+	return true;
+}
+
+bool save_cache(string const& fname, vector<BuiltPuzzle> const& puzzles)
+{
+	vector<u8> payload;
+	payload.reserve(puzzles.size() * 256);
+	for(BuiltPuzzle const& puz : puzzles)
+		write_record(payload, puz);
+	vector<u8> header;
+	header.insert(header.end(), std::begin(CACHE_MAGIC), std::end(CACHE_MAGIC));
+	put(header, CACHE_VERSION, 2);
+	put(header, puzzles.size(), 4);
+	put(header, payload.size(), 4);
+	put(header, checksum(payload.data(), payload.size()), 8);
+	
+	//Write beside the real file first, so a failed write can't leave a truncated cache
+	string tmpname = fname + ".tmp";
+	{
+		std::ofstream file(tmpname, std::ios::binary | std::ios::trunc);
+		file.write((char const*)header.data(), header.size());
+		file.write((char const*)payload.data(), payload.size());
+		if(!file)
+			return false;
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpname, fname, ec);
+	return !ec;
+}
+vector<BuiltPuzzle> load_cache(string const& fname)
+{
+	vector<BuiltPuzzle> ret;
+	std::ifstream file(fname, std::ios::binary);
+	if(!file)
+		return ret;
+	vector<u8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	CacheReader rd{data.data(), data.size()};
+	if(data.size() < CACHE_HEADER_SIZE || memcmp(data.data(), CACHE_MAGIC, 4))
+	{
+		error(format("Puzzle cache '{}' is not a cache file, ignoring it", fname));
+		return ret;
+	}
+	rd.pos = 4;
+	u16 version = rd.get(2);
+	u32 count = rd.get(4);
+	u32 size = rd.get(4);
+	u64 sum = rd.get(8);
+	if(version != CACHE_VERSION)
+	{
+		log(format("Puzzle cache '{}' is from another version, ignoring it", fname), true);
+		return ret;
+	}
+	if(size != data.size() - CACHE_HEADER_SIZE || count > size / CACHE_MIN_RECORD
+		|| sum != checksum(data.data() + CACHE_HEADER_SIZE, size))
+	{
+		error(format("Puzzle cache '{}' is corrupt, ignoring it", fname));
+		return ret;
+	}
+	ret.resize(count);
+	for(BuiltPuzzle& puz : ret)
+		if(!read_record(rd, puz))
+		{
+			error(format("Puzzle cache '{}' is corrupt, ignoring it", fname));
+			ret.clear();
+			return ret;
+		}
+	return ret;
+}
+
+}
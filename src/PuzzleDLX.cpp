@@ -0,0 +1,353 @@
+#include "PuzzleGen.hpp"
+#include "GridTables.hpp"
+#include <cstring>
+
+namespace PuzzleGen
+{
+using namespace GridTables;
+
+// Sudoku as an exact cover problem, solved with Knuth's Algorithm X / Dancing Links.
+//     Primary columns (each must be covered exactly once):
+//         81 cells, 81 row-digits, 81 column-digits, 81 box-digits
+//     Secondary columns (each may be covered at most once):
+//         cage-digits, one per (cage,digit)
+//     Rows: one per (cell,digit) placement
+// Cage sums don't fit exact cover. Instead each cage keeps only the rows whose digit is still
+//     in some combination that can complete it (as the backtracker prunes its options); the
+//     rest are hidden from their columns, so the column sizes the search branches on count them out.
+struct DancingLinks
+{
+	bool is_unique(PuzzleGrid const& grid);
+private:
+	static const u16 PRIMARY_COLS = 4*9*9;
+	static const u16 NUM_COLS = PRIMARY_COLS + 9*9*9;
+	static const u16 ROOT = NUM_COLS; //header of the primary column list
+	static const u16 NUM_ROWS = 9*9*9;
+	static const u16 MAX_NODES = NUM_COLS + 1 + NUM_ROWS*5;
+	
+	struct Node
+	{
+		u16 l, r, u, d;
+		u16 col, row;
+	};
+	Node nodes[MAX_NODES];
+	u16 col_size[NUM_COLS];
+	u16 row_node[NUM_ROWS];
+	u16 num_nodes;
+	
+	u8 cage_of[9*9]; // NO_CAGE if uncaged
+	u8 cage_sum_left[9*9];
+	u8 cage_cells_left[9*9];
+	u16 cage_used[9*9];
+	CellMask cage_cells[9*9];
+	u8 num_cages;
+	u16 hidden[NUM_ROWS]; //first node of each hidden row, in the order hidden
+	u16 num_hidden;
+	u8 solutions;
+	GenStats* stats; //the calling thread's
+	
+	void reset(PuzzleGrid const& grid);
+	void add_row(u16 row, u16 const* cols, u8 count);
+	void cover(u16 c);
+	void uncover(u16 c);
+	bool fits_cage(u16 row) const;
+	void place_cage(u16 row, bool add);
+	void prune_cage(u8 cage);
+	void unhide(u16 mark);
+	void search();
+};
+
+void DancingLinks::reset(PuzzleGrid const& grid)
+{
+	for(u16 c = 0; c <= ROOT; ++c)
+	{
+		Node& n = nodes[c];
+		n.u = n.d = c;
+		n.col = c;
+		if(c < NUM_COLS)
+			col_size[c] = 0;
+		if(c < PRIMARY_COLS)
+		{
+			n.l = c ? c-1 : ROOT;
+			n.r = (c+1 < PRIMARY_COLS) ? c+1 : ROOT;
+		}
+		else if(c == ROOT)
+		{
+			n.l = PRIMARY_COLS-1;
+			n.r = 0;
+		}
+		else n.l = n.r = c; //secondary columns aren't in the header list
+	}
+	num_nodes = ROOT+1;
+	
+	memset(cage_of, NO_CAGE, sizeof(cage_of));
+	num_cages = grid.cages.size();
+	for(u8 q = 0; q < num_cages; ++q)
+	{
+		Cage const& cage = grid.cages[q];
+		cage_sum_left[q] = cage.sum;
+		cage_cells_left[q] = cage.cells.size();
+		cage_used[q] = 0;
+		cage_cells[q] = cage.cells;
+		for(u8 index : cage.cells)
+			cage_of[index] = q;
+	}
+	
+	for(u8 index = 0; index < 9*9; ++index)
+	{
+		auto [row,col,box] = cell_units[index]; //unit ids, 0-26
+		for(u8 d = 0; d < 9; ++d)
+		{
+			//one column per (unit,digit) after the cell columns
+			u16 cols[5] = {
+				u16(index),
+				u16(81 + 9*row + d),
+				u16(81 + 9*col + d),
+				u16(81 + 9*box + d),
+				0
+			};
+			u8 count = 4;
+			if(cage_of[index] != NO_CAGE)
+				cols[count++] = u16(PRIMARY_COLS + 9*cage_of[index] + d);
+			add_row(u16(9*index + d), cols, count);
+		}
+	}
+	num_hidden = 0;
+	solutions = 0;
+}
+void DancingLinks::add_row(u16 row, u16 const* cols, u8 count)
+{
+	u16 first = num_nodes;
+	row_node[row] = first;
+	for(u8 q = 0; q < count; ++q)
+	{
+		u16 c = cols[q];
+		Node& n = nodes[num_nodes];
+		n.row = row;
+		n.col = c;
+		n.l = q ? num_nodes-1 : first+count-1;
+		n.r = (q+1 < count) ? num_nodes+1 : first;
+		n.d = c;
+		n.u = nodes[c].u;
+		nodes[n.u].d = num_nodes;
+		nodes[c].u = num_nodes;
+		++col_size[c];
+		++num_nodes;
+	}
+}
+void DancingLinks::cover(u16 c)
+{
+	Node& col = nodes[c];
+	nodes[col.r].l = col.l;
+	nodes[col.l].r = col.r;
+	for(u16 i = col.d; i != c; i = nodes[i].d)
+		for(u16 j = nodes[i].r; j != i; j = nodes[j].r)
+		{
+			Node& n = nodes[j];
+			nodes[n.d].u = n.u;
+			nodes[n.u].d = n.d;
+			--col_size[n.col];
+		}
+}
+void DancingLinks::uncover(u16 c)
+{
+	Node& col = nodes[c];
+	for(u16 i = col.u; i != c; i = nodes[i].u)
+		for(u16 j = nodes[i].l; j != i; j = nodes[j].l)
+		{
+			Node& n = nodes[j];
+			++col_size[n.col];
+			nodes[n.d].u = j;
+			nodes[n.u].d = j;
+		}
+	nodes[col.r].l = c;
+	nodes[col.l].r = c;
+}
+//If placing this row's digit still leaves the cage completable
+bool DancingLinks::fits_cage(u16 row) const
+{
+	u8 cage = cage_of[row/9];
+	if(cage == NO_CAGE)
+		return true;
+	u8 v = row%9 + 1;
+	if(v > cage_sum_left[cage])
+		return false;
+	u16 used = cage_used[cage] | opt_bit(v);
+	for(u16 combo : cage_combos_for(cage_cells_left[cage]-1, cage_sum_left[cage]-v))
+		if(!(combo & used))
+			return true;
+	return false;
+}
+void DancingLinks::place_cage(u16 row, bool add)
+{
+	u8 cage = cage_of[row/9];
+	if(cage == NO_CAGE)
+		return;
+	u8 v = row%9 + 1;
+	if(add)
+	{
+		cage_sum_left[cage] -= v;
+		--cage_cells_left[cage];
+		cage_used[cage] |= opt_bit(v);
+	}
+	else
+	{
+		cage_sum_left[cage] += v;
+		++cage_cells_left[cage];
+		cage_used[cage] &= ~opt_bit(v);
+	}
+}
+//Hides the rows of the cage's open cells whose digit is in no combination that can still
+//    complete it: the right count and sum, none already placed in it, and every digit
+//    still a row for some open cell
+void DancingLinks::prune_cage(u8 cage)
+{
+	auto combos = cage_combos_for(cage_cells_left[cage], cage_sum_left[cage]);
+	while(true)
+	{
+		u16 avail = 0;
+		for(u8 index : cage_cells[cage])
+			if(nodes[nodes[index].l].r == index) //cell column uncovered; it's open
+				for(u16 i = nodes[index].d; i != index; i = nodes[i].d)
+					avail |= opt_bit(nodes[i].row%9 + 1);
+		u16 valid = 0;
+		for(u16 combo : combos)
+			if(!(combo & cage_used[cage]) && (combo & avail) == combo)
+				valid |= combo;
+		if(!(avail & ~valid))
+			return; //nothing to hide
+		for(u8 index : cage_cells[cage])
+		{
+			if(nodes[nodes[index].l].r != index)
+				continue;
+			//A hidden node keeps its own links, so the walk carries on past it
+			for(u16 i = nodes[index].d; i != index; i = nodes[i].d)
+			{
+				if(valid & opt_bit(nodes[i].row%9 + 1))
+					continue;
+				u16 j = i;
+				do
+				{
+					Node& n = nodes[j];
+					nodes[n.d].u = n.u;
+					nodes[n.u].d = n.d;
+					--col_size[n.col];
+					j = n.r;
+				}
+				while(j != i);
+				hidden[num_hidden++] = i;
+			}
+		}
+	}
+}
+//Puts back the rows hidden since 'num_hidden' was 'mark', latest first
+void DancingLinks::unhide(u16 mark)
+{
+	while(num_hidden > mark)
+	{
+		u16 i = hidden[--num_hidden];
+		u16 j = i;
+		do
+		{
+			j = nodes[j].l;
+			Node& n = nodes[j];
+			++col_size[n.col];
+			nodes[n.d].u = j;
+			nodes[n.u].d = j;
+		}
+		while(j != i);
+	}
+}
+void DancingLinks::search()
+{
+	check_abort();
+	if(nodes[ROOT].r == ROOT) //every cell filled
+	{
+		++solutions;
+		return;
+	}
+	//Branch on the column with the fewest rows left
+	u16 c = nodes[ROOT].r;
+	for(u16 q = nodes[c].r; q != ROOT; q = nodes[q].r)
+		if(col_size[q] < col_size[c])
+			c = q;
+	if(!col_size[c])
+	{
+		++stats->backtracks;
+		return;
+	}
+	cover(c);
+	for(u16 r = nodes[c].d; r != c && solutions < 2; r = nodes[r].d)
+	{
+		//Pruning keeps every row left fitting its cage
+		u16 row = nodes[r].row;
+		u16 mark = num_hidden;
+		place_cage(row, true);
+		++stats->nodes;
+		for(u16 j = nodes[r].r; j != r; j = nodes[j].r)
+			cover(nodes[j].col);
+		if(num_cages)
+		{
+			//Its own cage, and any whose rows the placement just covered
+			u8 index = row/9;
+			CellMask dirty_cages;
+			dirty_cages.insert(cage_of[index]);
+			for(u8 q : peers[index])
+				dirty_cages.insert(cage_of[q]);
+			for(u8 cage : dirty_cages)
+				prune_cage(cage);
+		}
+		search();
+		unhide(mark);
+		for(u16 j = nodes[r].l; j != r; j = nodes[j].l)
+			uncover(nodes[j].col);
+		place_cage(row, false);
+	}
+	uncover(c);
+}
+bool DancingLinks::is_unique(PuzzleGrid const& grid)
+{
+	stats = &thread_stats();
+	reset(grid);
+	//Givens are chosen up-front
+	bool covered[NUM_COLS] = {0};
+	for(u8 index = 0; index < 9*9; ++index)
+	{
+		PuzzleCell const& cell = grid.cells[index];
+		if(!cell.given)
+			continue;
+		u16 row = 9*index + (cell.val-1);
+		u16 r = row_node[row];
+		if(!fits_cage(row))
+			return false;
+		u16 j = r;
+		do
+		{
+			if(covered[nodes[j].col]) //clashes with an earlier given
+				return false;
+			j = nodes[j].r;
+		}
+		while(j != r);
+		place_cage(row, true);
+		do
+		{
+			covered[nodes[j].col] = true;
+			cover(nodes[j].col);
+			j = nodes[j].r;
+		}
+		while(j != r);
+	}
+	for(u8 q = 0; q < num_cages; ++q)
+		prune_cage(q);
+	search();
+	return solutions == 1;
+}
+
+bool PuzzleGrid::is_unique_dlx() const
+{
+	//The node pool is large, so each thread keeps one to reuse
+	static thread_local DancingLinks dlx;
+	return dlx.is_unique(*this);
+}
+
+}
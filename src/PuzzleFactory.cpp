@@ -0,0 +1,546 @@
+#include "PuzzleGen.hpp"
+#include "Random.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <atomic>
+
+//The background pool serving 'request_puzzle'; the generator itself is in PuzzleGen.cpp
+namespace PuzzleGen
+{
+
+#define CACHE_FILE "APSudoku.puzzles" //beside APSudoku.cfg
+
+//Guarded by the factory's 'pool_mut', which every access already holds
+struct PuzzleQueue
+{
+	BuiltPuzzle take();
+	bool give(BuiltPuzzle const& puz); //false if the queue was full
+	void copy_ready(vector<BuiltPuzzle>& out) const;
+	size_t size() const;
+	bool can_serve() const;
+	void seed_isomorphs(u64 seed) {iso_rng.reseed(seed);}
+	
+	static const u8 CAPACITY = 16;
+private:
+	static const u8 NUM_BASES = 8;
+	BuiltPuzzle ring[CAPACITY];
+	u8 head = 0, count = 0;
+	BuiltPuzzle bases[NUM_BASES]; //recently generated puzzles, to serve isomorphs of when the queue runs dry
+	u8 num_bases = 0, next_base = 0;
+	Xoshiro256 iso_rng;
+};
+BuiltPuzzle PuzzleQueue::take()
+{
+	if(!count)
+	{
+		u64 iso_seed = iso_rng();
+		if(!iso_seed) //0 means 'not transformed'
+			iso_seed = 1;
+		return isomorph(bases[iso_rng.below(num_bases)], iso_seed);
+	}
+	u8 ind = head;
+	head = (head+1) % CAPACITY;
+	--count;
+	return ring[ind];
+}
+bool PuzzleQueue::give(BuiltPuzzle const& puz)
+{
+	bases[next_base] = puz;
+	next_base = (next_base+1) % NUM_BASES;
+	if(num_bases < NUM_BASES)
+		++num_bases;
+	if(count == CAPACITY) //if full, it still refreshes the bases
+		return false;
+	ring[(head + count++) % CAPACITY] = puz;
+	return true;
+}
+void PuzzleQueue::copy_ready(vector<BuiltPuzzle>& out) const
+{
+	for(u8 q = 0; q < count; ++q)
+		out.push_back(ring[(head+q) % CAPACITY]);
+}
+size_t PuzzleQueue::size() const
+{
+	return count;
+}
+bool PuzzleQueue::can_serve() const
+{
+	return count || num_bases;
+}
+
+typedef std::chrono::steady_clock Clock;
+static double secs_between(Clock::time_point a, Clock::time_point b)
+{
+	return std::chrono::duration<double>(b - a).count();
+}
+
+//How quickly one difficulty's puzzles are taken and built, to size its ready queue
+struct QueueDemand
+{
+	static const u8 MIN_READY = 2;
+	u8 target = MIN_READY; //puzzles to keep ready
+	
+	void add_build(double secs);
+	void add_take(Clock::time_point now);
+	bool retarget(double wait_chance); //true if 'target' changed
+	string describe() const;
+private:
+	static const u8 NUM_SAMPLES = 64;
+	float build_secs[NUM_SAMPLES]; //recent generation latencies
+	u8 num_samples = 0, next_sample = 0;
+	double mean_secs = 0, p95_secs = 1.0; //until measured, assume a slow build
+	double take_interval = 60.0; //smoothed seconds between puzzles being taken
+	optional<Clock::time_point> last_take;
+};
+void QueueDemand::add_build(double secs)
+{
+	build_secs[next_sample] = float(secs);
+	next_sample = (next_sample+1) % NUM_SAMPLES;
+	if(num_samples < NUM_SAMPLES)
+		++num_samples;
+	float sorted[NUM_SAMPLES];
+	std::copy_n(build_secs, num_samples, sorted);
+	double sum = 0;
+	for(u8 q = 0; q < num_samples; ++q)
+		sum += sorted[q];
+	mean_secs = sum / num_samples;
+	std::nth_element(sorted, sorted + (num_samples*95)/100, sorted + num_samples);
+	p95_secs = sorted[(num_samples*95)/100];
+}
+void QueueDemand::add_take(Clock::time_point now)
+{
+	if(last_take)
+		take_interval = 0.7*take_interval + 0.3*secs_between(*last_take, now);
+	last_take = now;
+}
+//Takes while a puzzle builds are treated as Poisson; keep enough ready that the queue
+//    emptying before a slow (p95) build finishes is less likely than 'wait_chance'
+bool QueueDemand::retarget(double wait_chance)
+{
+	double mean_takes = p95_secs / std::max(take_interval, 0.001);
+	double p = std::exp(-mean_takes), cdf = p;
+	u8 depth = 0;
+	while(cdf < 1.0 - wait_chance && depth < PuzzleQueue::CAPACITY)
+	{
+		++depth;
+		p *= mean_takes / depth;
+		cdf += p;
+	}
+	u8 old = target;
+	target = depth < MIN_READY ? MIN_READY : depth;
+	return target != old;
+}
+string QueueDemand::describe() const
+{
+	return format("keep {} ready (build mean {:.3f}s, p95 {:.3f}s; taken every {:.2f}s)",
+		target, mean_secs, p95_secs, take_interval);
+}
+
+static char const* diff_names[NUM_DIFF] = {"Easy","Normal","Hard","Killer"};
+static double wait_chance = 0.01;
+static double cpu_budget = 0.75;
+void set_wait_chance(double chance)
+{
+	wait_chance = chance;
+}
+void set_cpu_budget(double frac)
+{
+	cpu_budget = frac;
+}
+void log_stats()
+{
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		log(format("{} generation: {}", diff_names[d], get_stats(Difficulty(d)).describe()), true);
+}
+static std::function<void(Difficulty)> on_ready;
+void set_on_ready(std::function<void(Difficulty)> callback)
+{
+	on_ready = callback;
+}
+
+//One pool of workers serves every difficulty. Each worker keeps its 'home' difficulty
+//    stocked, helps whichever other queue is furthest below its target once its own is full,
+//    and drops everything for a difficulty the player is stuck waiting on.
+//Builds that stop being needed are cancelled through their stop token: ones for other
+//    difficulties when the player is waiting, and ones for a queue that's already stocked.
+//Background work draws on a budget of worker-seconds that refills at 'cpu_budget' of the pool;
+//    once spent, only empty queues are refilled until it recovers.
+struct PuzzleGenFactory
+{
+	static void request(Difficulty d, PuzzleTicket& ticket);
+	static void withdraw(PuzzleTicket& ticket);
+	static void init();
+	static void shutdown();
+private:
+	static PuzzleQueue puzzles[NUM_DIFF];
+	
+	Difficulty home;
+	u64 seed;
+	optional<Difficulty> task; //being built, guarded by 'pool_mut'
+	std::stop_source build_stop; //cancels just the current build, guarded by 'pool_mut'
+	std::jthread runtime;
+	
+	void run(std::stop_token stop);
+	optional<Difficulty> pick_task() const;
+	static void refill_budget();
+	static void update_urgent();
+	static void stop_builds(Difficulty d, bool other);
+	static const u8 BUDGET_BANK = 30; //seconds of the budget that can be saved up for bursts
+	static const u8 SLOW_BUILD = 2; //seconds; builds taking longer log their stats
+	
+	PuzzleGenFactory(Difficulty home, u64 seed) : home(home), seed(seed),
+		task(), build_stop(), runtime()
+	{}
+	static vector<std::unique_ptr<PuzzleGenFactory>> workers;
+	static std::atomic<bool> running;
+	static std::mutex pool_mut; //guards the ready queues, 'in_flight', 'waiting', and workers parking
+	static std::condition_variable_any work; //signalled when a queue may want more
+	static u8 in_flight[NUM_DIFF]; //puzzles being built for each difficulty
+	static std::atomic<u8> urgent; //difficulty a consumer is blocked on, or NUM_DIFF
+	static PuzzleTicket* waiting[NUM_DIFF]; //requests no queue could serve yet, oldest first, linked through their tickets
+	static u64 next_order; //stamps each waiting request, to find the oldest
+	static QueueDemand demand[NUM_DIFF];
+	static double budget_secs; //worker-seconds background work may still use
+	static Clock::time_point budget_time;
+};
+vector<std::unique_ptr<PuzzleGenFactory>> PuzzleGenFactory::workers;
+std::atomic<bool> PuzzleGenFactory::running = false;
+std::mutex PuzzleGenFactory::pool_mut;
+std::condition_variable_any PuzzleGenFactory::work;
+u8 PuzzleGenFactory::in_flight[NUM_DIFF] = {0};
+std::atomic<u8> PuzzleGenFactory::urgent = NUM_DIFF;
+PuzzleTicket* PuzzleGenFactory::waiting[NUM_DIFF] = {nullptr};
+u64 PuzzleGenFactory::next_order = 0;
+QueueDemand PuzzleGenFactory::demand[NUM_DIFF];
+double PuzzleGenFactory::budget_secs = 0;
+Clock::time_point PuzzleGenFactory::budget_time;
+PuzzleQueue PuzzleGenFactory::puzzles[NUM_DIFF];
+
+//Call with 'pool_mut' held
+void PuzzleGenFactory::refill_budget()
+{
+	double pool_secs = cpu_budget * workers.size();
+	Clock::time_point now = Clock::now();
+	budget_secs = std::min(budget_secs + pool_secs*secs_between(budget_time, now), pool_secs*BUDGET_BANK);
+	budget_time = now;
+}
+//Picks what to build next, or nullopt if every queue is stocked. Call with 'pool_mut' held.
+optional<Difficulty> PuzzleGenFactory::pick_task() const
+{
+	u8 u = urgent;
+	if(u != NUM_DIFF)
+		return Difficulty(u);
+	refill_budget();
+	bool over_budget = budget_secs <= 0;
+	auto wanted = [over_budget](u8 d)
+		{
+			if(bank_has(Difficulty(d))) //served from the bank instead
+				return 0;
+			int have = puzzles[d].size() + in_flight[d];
+			if(over_budget)
+				return have ? 0 : 1;
+			return int(demand[d].target) - have;
+		};
+	if(wanted(home) > 0)
+		return home;
+	optional<Difficulty> ret;
+	int most = 0;
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+	{
+		int w = wanted(d);
+		if(w > most)
+		{
+			most = w;
+			ret = Difficulty(d);
+		}
+	}
+	return ret;
+}
+//Points the pool at the longest-waiting request's difficulty. Call with 'pool_mut' held.
+void PuzzleGenFactory::update_urgent()
+{
+	//Each list is oldest first, so only the heads need comparing
+	u8 u = NUM_DIFF;
+	for(u8 d = 0; d < NUM_DIFF; ++d)
+		if(waiting[d] && (u == NUM_DIFF || waiting[d]->order < waiting[u]->order))
+			u = d;
+	urgent = u;
+}
+//Cancels the builds in progress for difficulty 'd' (or, if 'other', for every other difficulty).
+//    Call with 'pool_mut' held.
+void PuzzleGenFactory::stop_builds(Difficulty d, bool other)
+{
+	for(std::unique_ptr<PuzzleGenFactory>& w : workers)
+		if(w->task && (*w->task == d) != other)
+			w->build_stop.request_stop();
+}
+
+void PuzzleGenFactory::run(std::stop_token stop)
+{
+	Xoshiro256 seeds(seed); //each puzzle gets its own seed from the worker's stream
+	while(!stop.stop_requested())
+	{
+		std::stop_token build_token;
+		{
+			std::unique_lock lk(pool_mut);
+			auto picked = [this]()
+				{
+					return bool(task = pick_task());
+				};
+			while(!stop.stop_requested() && !picked())
+			{
+				if(budget_secs > 0)
+					work.wait(lk, stop, picked);
+				else //over budget; sleep until it's recovered
+					work.wait_for(lk, stop, std::chrono::duration<double>(
+						-budget_secs / (cpu_budget * workers.size()) + 0.01), picked);
+			}
+			if(!task)
+				break;
+			++in_flight[*task];
+			build_stop = std::stop_source();
+			build_token = build_stop.get_token();
+		}
+		Difficulty d = *task;
+		optional<BuiltPuzzle> puz;
+		Clock::time_point start = Clock::now();
+		try
+		{
+			puz = build_puzzle(d, seeds(), build_token);
+		}
+		catch(ignore_exception&)
+		{}
+		{
+			std::lock_guard lk(pool_mut);
+			task = nullopt;
+			double secs = secs_between(start, Clock::now());
+			budget_secs -= secs;
+			if(puz)
+			{
+				//Straight to whoever is waiting on it, else into the queue
+				if(PuzzleTicket* req = waiting[d])
+				{
+					waiting[d] = req->next;
+					req->fill(*puz);
+					update_urgent();
+				}
+				else puzzles[d].give(*puz);
+				demand[d].add_build(secs);
+				demand[d].retarget(wait_chance);
+				//Anything still building for a stocked queue is no longer needed
+				if(!waiting[d] && puzzles[d].size() >= demand[d].target)
+					stop_builds(d, false);
+				if(secs >= SLOW_BUILD)
+					log(format("Slow {} puzzle ({:.1f}s): {}", diff_names[d], secs, thread_stats().describe()), true);
+			}
+			--in_flight[d];
+			if(!puz) //someone else may need to pick this back up
+				work.notify_all();
+		}
+		if(puz && on_ready)
+			on_ready(d);
+	}
+}
+void PuzzleGenFactory::request(Difficulty d, PuzzleTicket& ticket)
+{
+	ticket.diff = d;
+	ticket.state = PuzzleTicket::TICKET_PENDING;
+	if(auto puz = draw_bank(d))
+	{
+		ticket.fill(*puz);
+		return;
+	}
+	std::lock_guard lk(pool_mut); //so a worker can't stock the queue between the check and the wait
+	PuzzleQueue& queue = puzzles[d];
+	if(queue.can_serve())
+		ticket.fill(queue.take());
+	else if(!running)
+		ticket.fail();
+	else
+	{
+		//Every worker switches over until this difficulty has a puzzle
+		PuzzleTicket** tail = &waiting[d];
+		while(*tail)
+			tail = &(*tail)->next;
+		ticket.next = nullptr;
+		ticket.order = next_order++;
+		*tail = &ticket;
+		update_urgent();
+		stop_builds(Difficulty(urgent.load()), true);
+	}
+	QueueDemand& dem = demand[d];
+	dem.add_take(Clock::now());
+	if(dem.retarget(wait_chance))
+		log(format("{} puzzles: {}", diff_names[d], dem.describe()), true);
+	work.notify_all(); //a slot opened up, or a request is waiting
+}
+//Unlinks a request that's still waiting. Also called for finished tickets, so one can't be
+//    destroyed while the worker that filled it is still notifying it.
+void PuzzleGenFactory::withdraw(PuzzleTicket& ticket)
+{
+	std::lock_guard lk(pool_mut);
+	if(ticket.state != PuzzleTicket::TICKET_PENDING)
+		return;
+	for(PuzzleTicket** p = &waiting[ticket.diff]; *p; p = &(*p)->next)
+		if(*p == &ticket)
+		{
+			*p = ticket.next;
+			break;
+		}
+	ticket.state = PuzzleTicket::TICKET_IDLE;
+	update_urgent();
+}
+static string bank_file;
+void set_bank(string const& fname)
+{
+	bank_file = fname;
+}
+static std::filesystem::path data_dir;
+void set_data_dir(string const& dir)
+{
+	data_dir = dir;
+}
+string data_path(string const& fname)
+{
+	return (data_dir / fname).string();
+}
+
+void PuzzleGenFactory::init()
+{
+	if(!bank_file.empty())
+		open_bank(bank_file);
+	log("Launching puzzle factories...", true);
+	log(format("Puzzle generator seed: {}", get_seed()), true);
+	u16 count = get_threads();
+	log(format("Puzzle generator threads: {}", count), true);
+	u64 worker = 0;
+	running = true;
+	for(u16 q = 0; q < count; ++q)
+	{
+		//Homes go to the slowest difficulties first
+		Difficulty home = Difficulty(NUM_DIFF-1 - (q % NUM_DIFF));
+		workers.emplace_back(new PuzzleGenFactory(home, worker_seed(worker++)));
+	}
+	for(u8 q = 0; q < NUM_DIFF; ++q)
+		puzzles[q].seed_isomorphs(worker_seed(worker++));
+	//Start warm, with whatever the last session left unserved. Shutdown never saves more than
+	//    a queue holds, but a cache from elsewhere might; the excess is dropped with the file.
+	string cache_file = data_path(CACHE_FILE);
+	vector<BuiltPuzzle> cached = load_cache(cache_file);
+	size_t dropped = 0;
+	for(BuiltPuzzle const& puz : cached)
+		if(!puzzles[puz.diff].give(puz))
+			++dropped;
+	if(!cached.empty())
+		log(format("Loaded {} cached puzzles", cached.size() - dropped), true);
+	if(dropped)
+		log(format("Dropped {} cached puzzles beyond the ready queues' capacity of {}",
+			dropped, u16(PuzzleQueue::CAPACITY)));
+	std::error_code ec;
+	std::filesystem::remove(cache_file, ec); //so a crash can't serve them twice
+	budget_secs = cpu_budget * count * BUDGET_BANK; //start with a full bank, for the initial fill
+	budget_time = Clock::now();
+	for(std::unique_ptr<PuzzleGenFactory>& w : workers)
+		w->runtime = std::jthread([worker = w.get()](std::stop_token stop)
+			{
+				worker->run(stop);
+			});
+	log("...launched!", true);
+}
+void PuzzleGenFactory::shutdown()
+{
+	if(!running)
+		return;
+	log("Closing puzzle factories...", true);
+	running = false;
+	{
+		//Stopping a worker's thread wakes it if parked; builds are cancelled separately
+		std::lock_guard lk(pool_mut);
+		for(std::unique_ptr<PuzzleGenFactory>& w : workers)
+		{
+			w->runtime.request_stop();
+			w->build_stop.request_stop();
+		}
+	}
+	for(std::unique_ptr<PuzzleGenFactory>& w : workers)
+		w->runtime.join();
+	workers.clear();
+	vector<BuiltPuzzle> unserved;
+	{
+		std::lock_guard lk(pool_mut);
+		for(PuzzleTicket*& reqs : waiting)
+			while(PuzzleTicket* req = reqs)
+			{
+				reqs = req->next;
+				req->fail();
+			}
+		update_urgent();
+		for(PuzzleQueue& queue : puzzles)
+			queue.copy_ready(unserved);
+	}
+	string cache_file = data_path(CACHE_FILE);
+	if(save_cache(cache_file, unserved))
+		log(format("Cached {} unserved puzzles", unserved.size()), true);
+	else error(format("Failed to write puzzle cache '{}'", cache_file));
+	close_bank();
+	log_stats();
+	log("...closed!", true);
+}
+
+void init()
+{
+	PuzzleGenFactory::init();
+}
+void shutdown()
+{
+	PuzzleGenFactory::shutdown();
+}
+
+PuzzleTicket::~PuzzleTicket()
+{
+	if(state != TICKET_IDLE)
+		PuzzleGenFactory::withdraw(*this);
+}
+bool PuzzleTicket::ready() const
+{
+	u8 s = state;
+	return s == TICKET_READY || s == TICKET_BROKEN;
+}
+BuiltPuzzle PuzzleTicket::get()
+{
+	state.wait(TICKET_PENDING);
+	if(state != TICKET_READY)
+		throw ignore_exception();
+	return puz;
+}
+void PuzzleTicket::fill(BuiltPuzzle const& p)
+{
+	puz = p;
+	state = TICKET_READY;
+	state.notify_all();
+}
+void PuzzleTicket::fail()
+{
+	state = TICKET_BROKEN;
+	state.notify_all();
+}
+
+void request_puzzle(Difficulty d, PuzzleTicket& ticket)
+{
+	PuzzleGenFactory::request(d, ticket);
+}
+BuiltPuzzle gen_puzzle(Difficulty d, optional<u64> seed)
+{
+	if(seed)
+		return build_puzzle(d, *seed);
+	PuzzleTicket ticket;
+	request_puzzle(d, ticket);
+	return ticket.get();
+}
+
+}
+
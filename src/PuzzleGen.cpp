@@ -1,262 +1,216 @@
-#include "Main.hpp"
-#include "GUI.hpp"
 #include "PuzzleGen.hpp"
+#include "GridTables.hpp"
+#include "PuzzleSimd.hpp"
+#include "Random.hpp"
 #include <thread>
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
 #include <mutex>
 
 namespace PuzzleGen
 {
+using namespace GridTables;
 
-struct PuzzleQueue
+static thread_local std::stop_token cur_stop; //of the build running on this thread
+//Makes 'stop' the calling thread's for its lifetime; nested builds without a token keep the outer one
+struct StopScope
 {
-	BuiltPuzzle take();
-	void give(BuiltPuzzle&& puz);
-	size_t size() const;
-	size_t atm_size();
-
-	bool try_lock_if_unempty();
-	
-	void lock() {mut.lock();}
-	bool try_lock() {return mut.try_lock();}
-	void unlock() {mut.unlock();}
-private:
-	deque<BuiltPuzzle> queue;
-	std::mutex mut;
+	std::stop_token prev;
+	StopScope(std::stop_token const& stop) : prev(cur_stop)
+	{
+		if(stop.stop_possible())
+			cur_stop = stop;
+	}
+	~StopScope()
+	{
+		cur_stop = prev;
+	}
 };
-BuiltPuzzle PuzzleQueue::take()
-{
-	BuiltPuzzle ret = queue.front();
-	queue.pop_front();
-	return ret;
-}
-void PuzzleQueue::give(BuiltPuzzle&& puz)
+void check_abort()
 {
-	queue.emplace_back(puz);
+	if(cur_stop.stop_requested())
+		throw ignore_exception();
 }
-size_t PuzzleQueue::size() const
+static thread_local GenStats cur_stats;
+GenStats& thread_stats()
 {
-	return queue.size();
-}
-size_t PuzzleQueue::atm_size()
-{
-	lock();
-	size_t ret = size();
-	unlock();
-	return ret;
-}
-bool PuzzleQueue::try_lock_if_unempty()
-{
-	if(!try_lock())
-		return false;
-	if(queue.empty())
-	{
-		unlock();
-		return false;
-	}
-	return true;
+	return cur_stats;
 }
 
-struct PuzzleGenFactory
+static std::atomic<SolverBackend> solver_backend = SOLVER_BACKTRACK;
+static u16 num_threads = 0;
+void set_threads(u16 count)
 {
-	static BuiltPuzzle get(Difficulty d);
-	static void init();
-	static void shutdown();
-private:
-	static const u8 KEEP_READY = 10;
-	static PuzzleQueue puzzles[NUM_DIFF];
-	
-	Difficulty d;
-	volatile bool running;
-	std::thread runtime;
-	
-	void run();
-	
-	PuzzleGenFactory() = default;
-	PuzzleGenFactory(Difficulty d) : d(d), running(false),
-		runtime()
-	{}
-	#define NUM_E_FAC       1
-	#define NUM_M_FAC       1
-	#define NUM_H_FAC       3
-	#define NUM_KILLER_FAC  3
-	static PuzzleGenFactory e_factories[NUM_E_FAC];
-	static PuzzleGenFactory m_factories[NUM_M_FAC];
-	static PuzzleGenFactory h_factories[NUM_H_FAC];
-	static PuzzleGenFactory killer_factories[NUM_KILLER_FAC];
-	static set<PuzzleGenFactory*> factories;
-};
-PuzzleGenFactory PuzzleGenFactory::e_factories[NUM_E_FAC];
-PuzzleGenFactory PuzzleGenFactory::m_factories[NUM_M_FAC];
-PuzzleGenFactory PuzzleGenFactory::h_factories[NUM_H_FAC];
-PuzzleGenFactory PuzzleGenFactory::killer_factories[NUM_KILLER_FAC];
-set<PuzzleGenFactory*> PuzzleGenFactory::factories;
-PuzzleQueue PuzzleGenFactory::puzzles[NUM_DIFF];
-
-void PuzzleGenFactory::run()
+	num_threads = count;
+}
+u16 get_threads()
 {
-	PuzzleQueue& queue = puzzles[d];
-	while(running && program_running)
-	{
-		try
-		{
-			if(queue.atm_size() >= KEEP_READY)
-			{
-				al_rest(0.05);
-				continue;
-			}
-			
-			PuzzleGrid puzzle(d); //generate the puzzle at current difficulty
-			//puzzle.print_sol();
-			//puzzle.print_cages();
-			//
-			BuiltPuzzle puz;
-			for(PuzzleCell const& cell : puzzle.cells)
-				puz.cells.emplace_back(cell.sol, cell.given);
-			for(Cage& cage : puzzle.cages)
-				puz.cages.emplace_back(std::move(cage.cells));
-			queue.lock();
-			queue.give(std::move(puz));
-			queue.unlock();
-			al_rest(0.05);
-		}
-		catch(ignore_exception&)
-		{}
-	}
+	if(num_threads)
+		return num_threads;
+	u16 hw = std::thread::hardware_concurrency();
+	return hw ? hw : 2; //unknown
 }
-BuiltPuzzle PuzzleGenFactory::get(Difficulty d)
+static u64 base_seed = 0;
+void set_seed(u64 seed)
 {
-	PuzzleQueue& queue = puzzles[d];
-	if(!queue.try_lock_if_unempty())
-	{
-		optional<u8> _ret;
-		bool _foo;
-		Dialog popup;
-		popups.emplace_back(&popup);
-		generate_popup(popup, _ret, _foo, "Please Wait", "Generating puzzle...", {});
-		popup.run_proc = [&queue]()
-			{
-				return !queue.try_lock_if_unempty();
-			};
-		popup.run_loop();
-		popups.pop_back();
-	}
-	if(!program_running)
-		throw ignore_exception();
-	
-	BuiltPuzzle puz = queue.take();
-	
-	queue.unlock();
-	
-	return puz;
+	base_seed = seed;
 }
-void PuzzleGenFactory::init()
+u64 get_seed()
 {
-	log("Launching puzzle factories...", true);
-	for(u8 q = 0; q < NUM_E_FAC; ++q)
-	{
-		PuzzleGenFactory& fac = e_factories[q];
-		new (&fac) PuzzleGenFactory(DIFF_EASY);
-		fac.running = true;
-		fac.runtime = std::thread(&PuzzleGenFactory::run, &fac);
-		factories.insert(&fac);
-	}
-	for(u8 q = 0; q < NUM_M_FAC; ++q)
-	{
-		PuzzleGenFactory& fac = m_factories[q];
-		new (&fac) PuzzleGenFactory(DIFF_NORMAL);
-		fac.running = true;
-		fac.runtime = std::thread(&PuzzleGenFactory::run, &fac);
-		factories.insert(&fac);
-	}
-	for(u8 q = 0; q < NUM_H_FAC; ++q)
-	{
-		PuzzleGenFactory& fac = h_factories[q];
-		new (&fac) PuzzleGenFactory(DIFF_HARD);
-		fac.running = true;
-		fac.runtime = std::thread(&PuzzleGenFactory::run, &fac);
-		factories.insert(&fac);
-	}
-	for(u8 q = 0; q < NUM_KILLER_FAC; ++q)
-	{
-		PuzzleGenFactory& fac = killer_factories[q];
-		new (&fac) PuzzleGenFactory(DIFF_KILLER);
-		fac.running = true;
-		fac.runtime = std::thread(&PuzzleGenFactory::run, &fac);
-		factories.insert(&fac);
-	}
-	log("...launched!", true);
+	if(!base_seed)
+		base_seed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	return base_seed;
 }
-void PuzzleGenFactory::shutdown()
+//Each worker gets its own seed derived from the base seed, so runs can be reproduced
+u64 worker_seed(u64 worker)
 {
-	log("Closing puzzle factories...", true);
-	for(PuzzleGenFactory* f : factories)
-		f->running = false;
-	for(PuzzleGenFactory* f : factories)
-		f->runtime.join();
-	log("...closed!", true);
+	//Hash the base first, or neighboring base seeds would share all but one stream
+	u64 base = get_seed();
+	u64 state = splitmix64(base) + worker;
+	return splitmix64(state);
 }
 
-void init()
+void set_solver(SolverBackend s)
 {
-	PuzzleGenFactory::init();
+	solver_backend = s;
 }
-void shutdown()
+SolverBackend get_solver()
 {
-	PuzzleGenFactory::shutdown();
+	return solver_backend;
 }
 
 PuzzleCell::PuzzleCell()
 	: val(0), given(true), cage(nullptr),
-	options({1,2,3,4,5,6,7,8,9})
+	options(OPTS_ALL)
 {}
 
-void PuzzleCell::reset_opts()
-{
-	options = {1,2,3,4,5,6,7,8,9};
-}
 void PuzzleCell::clear()
 {
 	*this = PuzzleCell();
 }
 
+//Fixed-capacity stack, so stepping/backtracking never touches the heap
+template<typename T, size_t N>
+struct FixedStack
+{
+	T& back() {return data[sz-1];}
+	bool empty() const {return !sz;}
+	size_t size() const {return sz;}
+	void pop_back() {--sz;}
+	template<typename... Args>
+	T& emplace_back(Args&&... args)
+	{
+		assert(sz < N);
+		return data[sz++] = T(std::forward<Args>(args)...);
+	}
+private:
+	T data[N];
+	size_t sz = 0;
+};
 struct GridFillHistory
 {
 	u8 ind;
-	map<u8,set<u8>> checked;
-	GridFillHistory() : ind(0), checked() {}
+	u16 checked; //options of 'ind' already tried at this step
+	u16 trail; //size of the solver's undo trail before this step
+	GridFillHistory() = default;
+	GridFillHistory(u8 ind, u16 trail) : ind(ind), checked(0), trail(trail) {}
 };
 struct GridGivenHistory
 {
 	u8 ind;
 	u8 built_cages;
-	set<u8> checked;
-	GridGivenHistory() : ind(0), built_cages(0), checked() {}
+	CellMask checked;
+	CellMask failed; //removals that broke uniqueness; fewer givens can't fix that, so deeper steps skip them too
+	GridGivenHistory() : ind(0), built_cages(0), checked(), failed() {}
 };
 
-set<u8> Cage::get_neighbors() const
+//Each thread generates from its own generator, never sharing state
+static thread_local Xoshiro256 gen_rng;
+void seed_thread_rng(u64 seed)
+{
+	gen_rng.reseed(seed);
+}
+
+//Random picks from bitmasks, without building any containers
+static u8 rand_cell(CellMask const& m)
+{
+	return m.nth(u8(gen_rng.below(m.size())));
+}
+static u8 rand_opt(u16 opts)
+{
+	for(u64 n = gen_rng.below(opt_count(opts)); n; --n)
+		opts &= opts-1;
+	return opt_lowest(opts);
+}
+
+CellMask Cage::get_neighbors() const
 {
-	set<u8> ret;
+	CellMask ret;
 	for(u8 c : cells)
+		for(u8 q : adjacent[c])
+			if(q != NO_CELL)
+				ret.insert(q);
+	return ret - cells; //cells in the cage aren't neighbors
+}
+
+//Range of the hardest technique each difficulty's puzzles may need, as {min, max}
+static const Technique grade_bands[NUM_DIFF][2] = {
+	{TECH_NONE, TECH_HIDDEN_SINGLE},
+	{TECH_NONE, TECH_NAKED_PAIR},
+	{TECH_LOCKED_CANDIDATES, TECH_GUESS},
+	{TECH_NONE, TECH_GUESS}, //the cages are the challenge
+};
+#define GRADE_TRIES 8 //grids built before settling for one outside the band
+PuzzleGrid::PuzzleGrid(Difficulty d, std::stop_token stop)
+	: PuzzleGrid()
+{
+	StopScope scope(stop);
+	for(u8 tries = 1;; ++tries)
+	{
+		populate();
+		build(d);
+		if(tries == GRADE_TRIES || (grade_bands[d][0] == TECH_NONE && grade_bands[d][1] == TECH_GUESS))
+			break;
+		Technique hardest = grade(grade_bands[d][1]).hardest;
+		if(hardest >= grade_bands[d][0] && hardest <= grade_bands[d][1])
+			break;
+		++cur_stats.regrades;
+		clear_cages();
+	}
+}
+PuzzleGrid::PuzzleGrid(BuiltPuzzle const& puz)
+	: PuzzleGrid()
+{
+	for(u8 q = 0; q < 9*9; ++q)
 	{
-		if(c-9 >= 0)
-			ret.insert(c-9);
-		if(c+9 < 81)
-			ret.insert(c+9);
-		if(c%9)
-			ret.insert(c-1);
-		if(c%9 < 8)
-			ret.insert(c+1);
+		PuzzleCell& cell = cells[q];
+		cell.sol = puz.solution(q);
+		cell.given = puz.given(q);
+		cell.val = cell.given ? cell.sol : 0;
 	}
-	for(u8 c : cells)
-		ret.erase(c); //cells in the cage aren't neighbors
-	return ret;
+	cages.resize(puz.num_cages);
+	for(u8 q = 0; q < puz.num_cages; ++q)
+		cages[q].sum = puz.cage_sums[q];
+	for(u8 q = 0; q < 9*9; ++q)
+		if(puz.cage_of[q] != NO_CAGE)
+		{
+			Cage& cage = cages[puz.cage_of[q]];
+			cage.cells.insert(q);
+			cells[q].cage = &cage;
+		}
 }
-
-PuzzleGrid::PuzzleGrid(Difficulty d)
+PuzzleGrid::PuzzleGrid(u8 const (&digits)[9*9])
 	: PuzzleGrid()
 {
-	populate();
-	build(d);
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		PuzzleCell& cell = cells[q];
+		cell.given = digits[q] != 0;
+		cell.sol = cell.val = digits[q];
+	}
 }
 PuzzleGrid::PuzzleGrid()
 {
@@ -292,163 +246,344 @@ PuzzleGrid PuzzleGrid::given_copy(PuzzleGrid const& g)
 	}
 	return ret;
 }
+GenStats& GenStats::operator+=(GenStats const& o)
+{
+	puzzles += o.puzzles;
+	abandoned += o.abandoned;
+	nodes += o.nodes;
+	backtracks += o.backtracks;
+	unique_calls += o.unique_calls;
+	unique_fails += o.unique_fails;
+	logic_accepts += o.logic_accepts;
+	cage_fills += o.cage_fills;
+	cage_exhausted += o.cage_exhausted;
+	restarts += o.restarts;
+	regrades += o.regrades;
+	return *this;
+}
+string GenStats::describe() const
+{
+	double per = puzzles+abandoned ? 1.0 / (puzzles+abandoned) : 0;
+	return format("{} built, {} abandoned; per build {:.0f} nodes, {:.0f} backtracks, "
+		"{:.1f} uniqueness checks ({:.1f}% failed), {:.1f} logic accepts, {:.1f} cage fills ({:.2f} exhausted), {:.2f} restarts, {:.2f} regrades",
+		puzzles, abandoned, nodes*per, backtracks*per, unique_calls*per,
+		unique_calls ? 100.0 * unique_fails / unique_calls : 0.0, logic_accepts*per,
+		cage_fills*per, cage_exhausted*per, restarts*per, regrades*per);
+}
+static std::mutex stats_mut;
+static GenStats stats_total[NUM_DIFF];
+GenStats get_stats(Difficulty d)
+{
+	std::lock_guard lk(stats_mut);
+	return stats_total[d];
+}
+//Adds the calling thread's counts to a difficulty's totals, however the build ends
+struct StatsScope
+{
+	Difficulty d;
+	StatsScope(Difficulty d) : d(d)
+	{
+		cur_stats = GenStats();
+	}
+	~StatsScope()
+	{
+		if(std::uncaught_exceptions())
+			++cur_stats.abandoned;
+		else ++cur_stats.puzzles;
+		std::lock_guard lk(stats_mut);
+		stats_total[d] += cur_stats;
+	}
+};
+
 bool PuzzleGrid::is_unique() const
 {
-	PuzzleGrid test = given_copy(*this);
-	return test.solve(true);
+	++cur_stats.unique_calls;
+	bool ret;
+	if(solver_backend == SOLVER_DLX)
+		ret = is_unique_dlx();
+	else
+	{
+		//Solve a copy of just the cells, sharing this grid's cages
+		PuzzleCell test[9*9];
+		for(u8 q = 0; q < 9*9; ++q)
+		{
+			test[q] = cells[q];
+			if(!test[q].given)
+				test[q].val = 0;
+		}
+		ret = solve_cells(test, cages, true);
+	}
+	if(!ret)
+		++cur_stats.unique_fails;
+	return ret;
+}
+u32 PuzzleGrid::solve_effort() const
+{
+	//Always the backtracker, so ratings compare across configs
+	PuzzleCell test[9*9];
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		test[q] = cells[q];
+		if(!test[q].given)
+			test[q].val = 0;
+	}
+	u64 start = cur_stats.nodes;
+	solve_cells(test, cages, true);
+	return u32(cur_stats.nodes - start);
 }
 
-pair<set<u8>,u8> PuzzleGrid::trim_opts(map<u8,set<u8>> const& banned)
+//Solver state, updated as values are placed/removed instead of being
+// recomputed for the whole grid at every step.
+struct GridSolver
 {
-	bool killer = false;
+	GridSolver(PuzzleCell* cells, vector<Cage> const& cages);
+	
+	void place(u8 index, u8 v);
+	void undo(u16 trail_mark);
+	
+	bool failed() const {return !by_count[0].empty();}
+	bool filled() const;
+	CellMask const& least_opts() const;
+	u16 trail_size() const {return trail_sz;}
+private:
+	PuzzleCell* cells;
+	Cage const* cages;
+	u16 unit_vals[NUM_UNITS] = {0};
+	u16 cage_vals[9*9] = {0};
+	//Empty cells, sorted by how many options they have
+	CellMask by_count[10];
+	//Undo record of every option change, as (cell,old options)
+	pair<u8,u16> trail[9*9*10];
+	u16 trail_sz = 0;
+	
+	u8 cage_index(u8 index) const
+	{
+		return u8(cells[index].cage - cages);
+	}
+	void set_opts(u8 index, u16 opts);
+	bool remove_opt(u8 index, u16 bit);
+	void prune_cage(u8 cage);
+};
+GridSolver::GridSolver(PuzzleCell* cells, vector<Cage> const& cage_vec)
+	: cells(cells), cages(cage_vec.data())
+{
+	for(u8 index = 0; index < 9*9; ++index)
+	{
+		PuzzleCell& cell = cells[index];
+		if(u8 v = cell.val)
+		{
+			for(u8 u : cell_units[index])
+				unit_vals[u] |= opt_bit(v);
+			if(cell.cage)
+				cage_vals[cage_index(index)] |= opt_bit(v);
+		}
+	}
 	//Calculate basic sudoku options
+	//    values placed in cells that 'see' a cell cannot be duplicated
+	u16 opts[9*9];
+	PuzzleSimd::eliminate(unit_vals, opts);
 	for(u8 index = 0; index < 9*9; ++index)
 	{
 		PuzzleCell& cell = cells[index];
 		if(cell.val)
 		{
-			cell.options.clear();
+			cell.options = 0;
 			continue; //skip filled cells
 		}
-		
-		//Start by assuming all valid digits are options
-		cell.options = {1,2,3,4,5,6,7,8,9};
-		
-		//Remove options that failed trial-and-error
-		auto banset = banned.find(index);
-		if(banset != banned.end())
-			for(u8 val : banset->second)
-				cell.options.erase(val);
-		
-		//Build a list of 'neighbors', the cells that 'see' this cell
-		u8 col = index%9;
-		u8 row = index/9;
-		u8 box = 3*(row/3)+(col/3);
-		set<u8> neighbors;
-		for(u8 q = 0; q < 9; ++q)
-		{
-			neighbors.insert(9*q + col); //same column
-			neighbors.insert(9*row + q); //same row
-			neighbors.insert(9*(3*(box/3) + (q/3)) + (3*(box%3) + (q%3))); //same box
-		}
-		if(cell.cage) //cells in the same cage are also neighbors
-			for(u8 q : cell.cage->cells)
-				neighbors.insert(q);
-		
-		//values placed in neighbor cells cannot be duplicated
-		for(u8 q : neighbors)
-			cell.options.erase(cells[q].val);
-		
-		if(cell.cage)
-			killer = true;
+		cell.options = opts[index];
+		if(cell.cage) //cells in the same cage also 'see' this cell
+			cell.options &= ~cage_vals[cage_index(index)];
+		by_count[opt_count(cell.options)].insert(index);
 	}
 	//Killer cages have special logic
-	if(killer)
+	for(u8 q = 0; q < cage_vec.size(); ++q)
+		prune_cage(q);
+	trail_sz = 0; //initial state is never undone
+}
+bool GridSolver::filled() const
+{
+	for(CellMask const& m : by_count)
+		if(!m.empty())
+			return false;
+	return true;
+}
+CellMask const& GridSolver::least_opts() const
+{
+	for(CellMask const& m : by_count)
+		if(!m.empty())
+			return m;
+	return by_count[0];
+}
+void GridSolver::set_opts(u8 index, u16 opts)
+{
+	PuzzleCell& cell = cells[index];
+	trail[trail_sz++] = {index, cell.options};
+	by_count[opt_count(cell.options)].erase(index);
+	by_count[opt_count(opts)].insert(index);
+	cell.options = opts;
+}
+bool GridSolver::remove_opt(u8 index, u16 bit)
+{
+	PuzzleCell& cell = cells[index];
+	if(cell.val || !(cell.options & bit))
+		return false;
+	set_opts(index, cell.options & ~bit);
+	return true;
+}
+//Eliminate options based on the cage's sum clue
+//    Each empty cell keeps only digits from the combinations that can still
+//    complete the cage: the right count and sum, none already placed in it,
+//    and every digit still an option for some empty cell.
+void GridSolver::prune_cage(u8 cage_ind)
+{
+	Cage const& cage = cages[cage_ind];
+	u8 placed_sum = 0, cells_left = 0;
+	for(u8 q : cage.cells)
 	{
-		bool didsomething = false;
-		do
+		if(u8 v = cells[q].val)
+			placed_sum += v;
+		else ++cells_left;
+	}
+	if(!cells_left)
+		return;
+	auto combos = cage_combos_for(cells_left, cage.sum - placed_sum);
+	if(placed_sum > cage.sum)
+		combos = {};
+	u16 placed = cage_vals[cage_ind];
+	while(true)
+	{
+		u16 avail = 0;
+		for(u8 q : cage.cells)
+			if(!cells[q].val)
+				avail |= cells[q].options;
+		u16 valid = 0;
+		for(u16 combo : combos)
+			if(!(combo & placed) && (combo & avail) == combo)
+				valid |= combo;
+		if(!(avail & ~valid))
+			break; //nothing to eliminate
+		for(u8 q : cage.cells)
 		{
-			didsomething = false;
-			for(u8 index = 0; index < 9*9; ++index)
-			{
-				PuzzleCell& cell = cells[index];
-				if(cell.val)
-					continue; //skip filled cells
-				if(!cell.cage)
-					continue; //skip uncaged cells
-				u8 target_sum = cell.cage->sum;
-				if(cell.cage->cells.size() == 1)
-				{
-					//1-cell cage, just force the value
-					for(auto it = cell.options.begin(); it != cell.options.end();)
-					{
-						if(*it == target_sum)
-							++it;
-						else it = cell.options.erase(it);
-					}
-					continue;
-				}
-				u8 lowest_sum = 0; //the sum of every cell's lowest option (excluding current cell)
-				u8 highest_sum = 0; //the sum of every cell's highest option (excluding current cell)
-				for(u8 q : cell.cage->cells)
-				{
-					if(q == index)
-						continue; //don't count current cell
-					if(u8 v = cells[q].val)
-					{
-						lowest_sum += v;
-						highest_sum += v;
-					}
-					else if(!cells[q].options.empty())
-					{
-						auto& opts = cells[q].options;
-						auto low_it = opts.begin();
-						auto high_it = opts.rbegin();
-						assert(low_it != opts.end() && high_it != opts.rend());
-						lowest_sum += *low_it;
-						highest_sum += *high_it;
-					}
-				}
-				//Eliminate options based on sum clues
-				for(auto it = cell.options.begin(); it != cell.options.end();)
-				{
-					auto v = *it;
-					if(lowest_sum+v > target_sum //Values that would go over the target
-						|| highest_sum+v < target_sum) //Values that fail to reach the target
-					{
-						it = cell.options.erase(it);
-						didsomething = true;
-					}
-					else ++it;
-				}
-			}
+			PuzzleCell& cell = cells[q];
+			if(!cell.val && (cell.options & ~valid))
+				set_opts(q, cell.options & valid);
 		}
-		while(didsomething);
 	}
-	set<u8> least_opts;
-	u8 least_count = 9;
-	for(u8 index = 0; index < 9*9; ++index)
+}
+//Places 'v' in the cell, removing it as an option from every cell that 'sees' it
+void GridSolver::place(u8 index, u8 v)
+{
+	PuzzleCell& cell = cells[index];
+	u16 bit = opt_bit(v);
+	set_opts(index, 0);
+	by_count[0].erase(index);
+	cell.val = v;
+	
+	for(u8 u : cell_units[index])
+		unit_vals[u] |= bit;
+	CellMask dirty_cages;
+	auto trim = [&](u8 q)
+		{
+			if(remove_opt(q, bit) && cells[q].cage)
+				dirty_cages.insert(cage_index(q));
+		};
+	for(u8 q : peers[index])
+		trim(q);
+	if(cell.cage)
 	{
+		u8 cage = cage_index(index);
+		cage_vals[cage] |= bit;
+		for(u8 q : cell.cage->cells)
+			trim(q);
+		dirty_cages.insert(cage);
+	}
+	for(u8 cage : dirty_cages)
+		prune_cage(cage);
+}
+//Reverts every placement and option change made since 'trail_mark'
+void GridSolver::undo(u16 trail_mark)
+{
+	while(trail_sz > trail_mark)
+	{
+		auto [index,opts] = trail[--trail_sz];
 		PuzzleCell& cell = cells[index];
-		if(cell.val)
-			continue; //skip filled cells
-		//Now that we've applied all of the rules
-		// we check if this cell has the least options, including ties
-		u8 sz = (u8)cell.options.size();
-		if(sz < least_count)
+		if(u8 v = cell.val) //placed cell, remove the value
 		{
-			least_opts.clear();
-			least_count = sz;
+			u16 bit = opt_bit(v);
+			for(u8 u : cell_units[index])
+				unit_vals[u] &= ~bit;
+			if(cell.cage)
+				cage_vals[cage_index(index)] &= ~bit;
+			cell.val = 0;
+			by_count[0].insert(index);
 		}
-		if(sz == least_count)
-			least_opts.insert(index);
-		if(least_count == 0)
-			break; //can early-return, as a 0 count indicates failure regardless
+		by_count[opt_count(cell.options)].erase(index);
+		by_count[opt_count(opts)].insert(index);
+		cell.options = opts;
 	}
-	//Returns the set of cells that had the least number of options
-	// paired with how many options they had
-	return {least_opts, least_count};
 }
 
 bool PuzzleGrid::solve(bool check_unique)
+{
+	return solve_cells(cells, cages, check_unique);
+}
+//Uniqueness checks search every branch anyway, so they take cells/options in order
+//    rather than drawing from the generator; the puzzle then depends only on its seed.
+static u8 pick_cell(CellMask const& m, bool random)
+{
+	return random ? rand_cell(m) : m.first();
+}
+static u8 pick_opt(u16 opts, bool random)
+{
+	return random ? rand_opt(opts) : opt_lowest(opts);
+}
+bool PuzzleGrid::solve_cells(PuzzleCell* cells, vector<Cage> const& cages, bool check_unique)
 {
 	// if `check_unique` is true, the puzzle will be mangled,
 	//     but the function will return if it has a unique solution.
 	// else, the puzzle will be solved with a unique solution, returning success.
-	for (PuzzleCell& c : cells)
-		c.reset_opts();
+	GridSolver solver(cells, cages);
 	bool solved = false;
-	vector<GridFillHistory> history;
-	history.emplace_back(); //add first step
+	FixedStack<GridFillHistory, 9*9> history; //never deeper than one step per cell
+	bool goback = solver.failed();
+	if(!goback)
+	{
+		if(solver.filled()) //already solved
+			return true;
+		history.emplace_back(pick_cell(solver.least_opts(), !check_unique), solver.trail_size());
+	}
 	while(true)
 	{
-		if(!program_running)
-			throw ignore_exception();
+		check_abort();
+		if(goback) //failure
+		{
+			// Step back, undoing the last placement
+			if(history.empty())
+				break;
+			solver.undo(history.back().trail);
+			goback = false;
+		}
 		GridFillHistory& step = history.back();
-		// Trim the options, accounting for anything we've already failed trying
-		auto [rem,cnt] = trim_opts(step.checked);
-		bool goback = cnt == 0;
-		if(rem.empty() && !goback) //success
+		// Try an option not already tried for this step's cell
+		u16 opts = cells[step.ind].options & ~step.checked;
+		if(!opts)
+		{
+			// Every option failed, so this is a bad path
+			history.pop_back();
+			goback = true;
+			continue;
+		}
+		u8 v = pick_opt(opts, !check_unique);
+		step.checked |= opt_bit(v);
+		solver.place(step.ind, v);
+		++cur_stats.nodes;
+		if(solver.failed())
+		{
+			++cur_stats.backtracks;
+			goback = true;
+			continue;
+		}
+		if(solver.filled()) //success
 		{
 			if(check_unique)
 			{
@@ -456,26 +591,13 @@ bool PuzzleGrid::solve(bool check_unique)
 					return false;
 				solved = true;
 				goback = true;
+				continue;
 			}
 			else return true;
 		}
-		if(goback) //failure
-		{
-			// Step back, and mark this as a bad path
-			history.pop_back();
-			if(history.empty())
-				break;
-			GridFillHistory& prev = history.back();
-			cells[prev.ind].clear();
-			continue;
-		}
 		// continuing
-		// Assign a random least-options cell to a random of its options
-		step.ind = *rand(rem);
-		PuzzleCell& c = cells[step.ind];
-		c.val = *rand(c.options);
-		step.checked[step.ind].insert(c.val);
-		history.emplace_back(); //add the next step
+		// Step into a least-options cell
+		history.emplace_back(pick_cell(solver.least_opts(), !check_unique), solver.trail_size());
 	}
 	return solved;
 }
@@ -492,30 +614,31 @@ void PuzzleGrid::populate()
 void PuzzleGrid::killer_fill()
 {
 	cages.clear(); //clear any from prior failures
+	cages.reserve(9*9); //never more cages than cells
 	//Generate random cages of size 1-5 filling the entire grid
 	static const u8 lowsz = 2, highsz = 7;
-	set<u8> remaining;
-	for(u8 q = 0; q < 81; ++q)
-		remaining.insert(q);
+	CellMask remaining = CellMask::all();
 	while(!remaining.empty())
 	{
 		Cage& cage = cages.emplace_back();
-		set<u8> values;
-		u8 target_size = rand(lowsz,highsz);
-		u8 seed = *rand(remaining);
+		u16 values = 0;
+		u8 target_size = gen_rng.between(lowsz,highsz);
+		u8 seed = rand_cell(remaining);
 		remaining.erase(seed);
 		cage.cells.insert(seed);
-		values.insert(cells[seed].sol);
+		values |= opt_bit(cells[seed].sol);
 		while(cage.cells.size() < target_size)
 		{
-			auto neighbors = cage.get_neighbors();
-			erase_if(neighbors, [&](u8 v){return values.contains(cells[v].sol) || !remaining.contains(v);});
+			CellMask neighbors = cage.get_neighbors() & remaining;
+			for(u8 v : neighbors)
+				if(values & opt_bit(cells[v].sol))
+					neighbors.erase(v);
 			if(neighbors.empty())
 				break; //no possible room to grow, end early
-			u8 next = *rand(neighbors);
+			u8 next = rand_cell(neighbors);
 			remaining.erase(next);
 			cage.cells.insert(next);
-			values.insert(cells[next].sol);
+			values |= opt_bit(cells[next].sol);
 		}
 	}
 	for(Cage& cage : cages)
@@ -528,11 +651,105 @@ void PuzzleGrid::killer_fill()
 		}
 	}
 }
+//The other givens pin this cell to its solution as a naked or hidden single,
+//    so blanking it leaves the puzzle's solutions unchanged
+bool PuzzleGrid::forced_by_givens(u8 index) const
+{
+	u16 seen = 0;
+	for(u8 p : peers[index])
+		if(cells[p].given)
+			seen |= opt_bit(cells[p].sol);
+	if(opt_count(OPTS_ALL & ~seen) == 1)
+		return true;
+	//Units already holding this cell's digit, as bitmasks of unit ids
+	u8 v = cells[index].sol;
+	u32 blocked = 0;
+	for(u8 q = 0; q < 9*9; ++q)
+		if(q != index && cells[q].given && cells[q].sol == v)
+			for(u8 u : cell_units[q])
+				blocked |= 1 << u;
+	for(u8 u : cell_units[index])
+	{
+		bool only = true;
+		for(u8 q : units[u])
+		{
+			if(q == index || cells[q].given)
+				continue;
+			auto const& cu = cell_units[q];
+			if(!(blocked & ((1 << cu[0]) | (1 << cu[1]) | (1 << cu[2]))))
+			{
+				only = false;
+				break;
+			}
+		}
+		if(only)
+			return true;
+	}
+	return false;
+}
+//Unavoidable sets of a filled grid: cells that can't all be blanks in a unique puzzle.
+//    Each pair of digits holds one cell per unit, so its 18 cells split into cycles
+//    linked through shared units; swapping the two digits around any cycle gives
+//    another valid grid. The 4-cell cycles are the classic deadly rectangles.
+#define MAX_UNAVOIDABLE (36*4) //each digit pair's cycles have at least 4 of its 18 cells
+static u8 find_unavoidable(PuzzleCell const (&cells)[9*9], CellMask (&out)[MAX_UNAVOIDABLE])
+{
+	u8 where[10][NUM_UNITS]; //cell holding each digit in each unit
+	for(u8 q = 0; q < 9*9; ++q)
+		for(u8 u : cell_units[q])
+			where[cells[q].sol][u] = q;
+	u8 count = 0;
+	for(u8 a = 1; a <= 9; ++a)
+		for(u8 b = a+1; b <= 9; ++b)
+		{
+			CellMask left;
+			for(u8 u = UNIT_ROW; u < UNIT_ROW+9; ++u)
+			{
+				left.insert(where[a][u]);
+				left.insert(where[b][u]);
+			}
+			while(!left.empty())
+			{
+				CellMask cycle;
+				u8 stack[18];
+				u8 depth = 0;
+				stack[depth++] = left.first();
+				cycle.insert(stack[0]);
+				while(depth)
+				{
+					u8 q = stack[--depth];
+					u8 other = cells[q].sol == a ? b : a;
+					for(u8 u : cell_units[q])
+						if(u8 p = where[other][u]; !cycle.contains(p))
+						{
+							cycle.insert(p);
+							stack[depth++] = p;
+						}
+				}
+				left -= cycle;
+				out[count++] = cycle;
+			}
+		}
+	return count;
+}
+//Cells that are the last of some unavoidable set among 'kept'; blanking one can't stay unique
+static CellMask pinned_cells(CellMask const* sets, u8 num_sets, CellMask const& kept)
+{
+	CellMask ret;
+	for(u8 q = 0; q < num_sets; ++q)
+	{
+		CellMask left = sets[q] & kept;
+		if(left.size() == 1)
+			ret |= left;
+	}
+	return ret;
+}
+#define RESTART_CHECKS 1000 //uniqueness checks a build attempt may spend before starting over
 //Starting from a filled grid, trims away givens
 void PuzzleGrid::build(Difficulty d)
 {
 	//Grid should be filled with a valid end solution before call
-	set<u8> givens;
+	CellMask givens;
 	for(u8 q = 0; q < 9*9; ++q)
 	{
 		if(!cells[q].given)
@@ -543,13 +760,19 @@ void PuzzleGrid::build(Difficulty d)
 	u8 target_givens = 81;
 	u8 givens_for_cages = 0;
 	bool killer_mode = false;
+	//Removals that singles still solve are unique without a search. Easy requires it,
+	//    as its grade band allows nothing harder; Normal falls back to the full check.
+	//    Any tier skips the check when the removed cell is itself a single.
+	bool singles_mode = false;
 	switch(d)
 	{
 		case DIFF_EASY:
 			target_givens = 46;
+			singles_mode = true;
 			break;
 		case DIFF_NORMAL:
 			target_givens = 35;
+			singles_mode = true;
 			break;
 		case DIFF_HARD:
 			target_givens = 26;
@@ -563,18 +786,56 @@ void PuzzleGrid::build(Difficulty d)
 	if(givens_for_cages < target_givens)
 		givens_for_cages = target_givens;
 	
+	u32 attempt_checks = 0;
+	bool restart = false;
+	//Whether the puzzle stays unique with these cells just blanked
+	auto removal_ok = [&](u8 count)
+		{
+			if(singles_mode && singles_solvable())
+			{
+				++cur_stats.logic_accepts;
+				return true;
+			}
+			//Batches for the singles tiers bisect rather than pay for the full check
+			if(d == DIFF_EASY || (count > 1 && singles_mode))
+				return false;
+			++attempt_checks;
+			return is_unique();
+		};
+	//Removals that would empty an unavoidable set are never tried. Cages can rule out
+	//    the swaps that make a set unavoidable, so only cageless steps use them. Easy
+	//    never runs the full check, so for it the sets cost more than they save.
+	CellMask unavoidable[MAX_UNAVOIDABLE];
+	u8 num_unavoidable = d != DIFF_EASY ? find_unavoidable(cells, unavoidable) : 0;
+	//Recent share of checked removals that kept the puzzle unique. Batches are sized so
+	//    about half pass whole: bigger ones fail too often, and bisecting costs more checks.
+	//    Integer math throughout, so every machine tries the same removals.
+	u16 accept_rate = 900; //per mille
 	do
 	{
-		set<u8> killer_singles;
+		attempt_checks = 0;
+		restart = false;
+		CellMask killer_singles;
 		if(target_givens)
 		{
-			vector<GridGivenHistory> history;
+			FixedStack<GridGivenHistory, 9*9+2> history;
 			history.emplace_back();
 			bool backtrack = false;
 			while(true)
 			{
-				if(!program_running)
-					throw ignore_exception();
+				check_abort();
+				//Rare Hard/Killer attempts wander into a dead end near the target that
+				//    takes a very long time to back out of; starting over down a fresh
+				//    random path is far cheaper. Easy and Normal never get near the budget.
+				if(!singles_mode && attempt_checks > RESTART_CHECKS)
+				{
+					clear_cages();
+					for(u8 q = 0; q < 9*9; ++q)
+						cells[q].given = true;
+					givens = CellMask::all();
+					restart = true;
+					break;
+				}
 				if(backtrack)
 				{
 					if(history.back().built_cages)
@@ -596,43 +857,110 @@ void PuzzleGrid::build(Difficulty d)
 				{
 					if(++step.built_cages >= 50)
 					{
+						++cur_stats.cage_exhausted;
 						backtrack = true;
 						continue;
 					}
 					//log("Building cages!");
 					killer_singles.clear();
+					++cur_stats.cage_fills;
 					killer_fill();
 					if(givens.size() == target_givens)
 						return; //success!
 					for(Cage& cage : cages)
 						if(cage.cells.size() == 1)
-							killer_singles.insert(*cage.cells.begin());
+							killer_singles.insert(cage.cells.first());
 					if(killer_singles.size() > target_givens)
 						continue;
 					history.emplace_back();
 					continue;
 				}
-				set<u8> possible = givens;
-				for(u8 q : step.checked)
-					possible.erase(q);
-				for(u8 q : killer_singles)
-					possible.erase(q);
+				u8 num_sets = cages.empty() ? num_unavoidable : 0;
+				CellMask possible = givens - step.checked - step.failed - killer_singles
+					- pinned_cells(unavoidable, num_sets, givens);
 				if(possible.empty()) //fail, need backtrack
 				{
 					backtrack = true;
 					continue;
 				}
-				step.ind = *rand(possible);
-				cells[step.ind].given = false;
-				step.checked.insert(step.ind);
-				if(!is_unique()) //fail, retry this step
+				//Remove a batch at once, bisecting it on failure to find the removals at fault.
+				//    Each removal still takes its own history step, so backtracking is unchanged.
+				auto commit = [&](u8 ind)
+					{
+						GridGivenHistory& cur = history.back();
+						cur.ind = ind;
+						cur.checked.insert(ind);
+						givens.erase(ind);
+						CellMask failed = cur.failed;
+						history.emplace_back();
+						history.back().failed = failed;
+					};
+				u8 stop_at = killer_mode && givens.size() > givens_for_cages ? givens_for_cages : target_givens;
+				//Largest batch that passes whole at least half the time: rate^batch >= 1/2
+				u8 batch = 0;
+				for(u32 pass = 1000; batch < 32; ++batch)
 				{
-					cells[step.ind].given = true;
-					continue;
+					pass = pass * std::min<u16>(accept_rate, 990) / 1000;
+					if(pass < 500)
+						break;
+				}
+				batch = std::max<u8>(batch, 1);
+				u8 picked[32];
+				u8 count = 0;
+				CellMask batched;
+				while(count < batch && !possible.empty() && givens.size() - count > stop_at)
+				{
+					u8 ind = rand_cell(possible);
+					possible.erase(ind);
+					cells[ind].given = false;
+					if(forced_by_givens(ind)) //no check needed
+					{
+						++cur_stats.logic_accepts;
+						commit(ind);
+					}
+					else
+					{
+						cells[ind].given = true;
+						picked[count++] = ind;
+						batched.insert(ind);
+					}
+					//Keep the batch from emptying a set between its picks
+					possible -= pinned_cells(unavoidable, num_sets, givens - batched);
+				}
+				FixedStack<std::pair<u8,u8>, 16> ranges; //[first, last) of 'picked' left to try, next on top
+				if(count)
+					ranges.emplace_back(0, count);
+				while(!ranges.empty())
+				{
+					auto [first, last] = ranges.back();
+					ranges.pop_back();
+					for(u8 q = first; q < last; ++q)
+						cells[picked[q]].given = false;
+					if(removal_ok(last - first))
+					{
+						for(u8 q = first; q < last; ++q)
+						{
+							commit(picked[q]);
+							accept_rate = (9*accept_rate + 1000) / 10;
+						}
+						continue;
+					}
+					for(u8 q = first; q < last; ++q)
+						cells[picked[q]].given = true;
+					if(last - first == 1)
+					{
+						history.back().checked.insert(picked[first]);
+						history.back().failed.insert(picked[first]);
+						accept_rate = 9*accept_rate / 10;
+						continue;
+					}
+					u8 mid = (first + last) / 2;
+					ranges.emplace_back(mid, last);
+					ranges.emplace_back(first, mid);
 				}
-				givens.erase(step.ind);
 				//log(format("Reached {} / {}", givens.size(), target_givens));
-				history.emplace_back();
+				if(givens.size() > stop_at)
+					continue;
 				if(killer_mode && givens.size() == givens_for_cages)
 					++(history.back().built_cages);
 				else if(givens.size() == target_givens)
@@ -646,8 +974,10 @@ void PuzzleGrid::build(Difficulty d)
 			if(is_unique())
 				return; //success!
 		}
+		if(killer_mode || restart)
+			++cur_stats.restarts;
 	}
-	while(killer_mode); //killer mode retries from start on failure
+	while(killer_mode || restart); //killer mode retries from start on failure; hard too, over budget
 	throw puzzle_gen_exception("grid build error");
 }
 
@@ -714,9 +1044,125 @@ void PuzzleGrid::print_sol() const
 	}
 }
 
-BuiltPuzzle gen_puzzle(Difficulty d)
+//The solver only tracks which digits each unit holds, so givens that repeat a digit
+//    in a unit have to be ruled out up front
+static bool givens_valid(u8 const (&digits)[9*9])
+{
+	u16 seen[NUM_UNITS] = {0};
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		u8 v = digits[q];
+		if(!v)
+			continue;
+		if(v > 9)
+			return false;
+		for(u8 u : cell_units[q])
+		{
+			if(seen[u] & opt_bit(v))
+				return false;
+			seen[u] |= opt_bit(v);
+		}
+	}
+	return true;
+}
+bool solve_grid(u8 (&digits)[9*9])
+{
+	if(!givens_valid(digits))
+		return false;
+	PuzzleGrid grid(digits);
+	if(!grid.solve(false))
+		return false;
+	for(u8 q = 0; q < 9*9; ++q)
+		digits[q] = grid.cells[q].val;
+	return true;
+}
+bool unique_grid(u8 const (&digits)[9*9])
+{
+	return givens_valid(digits) && PuzzleGrid(digits).is_unique();
+}
+
+BuiltPuzzle build_puzzle(Difficulty d, u64 seed, std::stop_token stop)
 {
-	return PuzzleGenFactory::get(d);
+	seed_thread_rng(seed);
+	StatsScope stats(d);
+	PuzzleGrid puzzle(d, stop);
+	//puzzle.print_sol();
+	//puzzle.print_cages();
+	//
+	BuiltPuzzle puz{};
+	puz.seed = seed;
+	puz.iso_seed = 0;
+	puz.diff = d;
+	memset(puz.cage_of, NO_CAGE, sizeof(puz.cage_of));
+	for(u8 index = 0; index < 9*9; ++index)
+	{
+		PuzzleCell const& cell = puzzle.cells[index];
+		puz.set_solution(index, cell.sol);
+		if(cell.given)
+			puz.givens.insert(index);
+	}
+	puz.num_cages = puzzle.cages.size();
+	for(u8 q = 0; q < puz.num_cages; ++q)
+	{
+		Cage const& cage = puzzle.cages[q];
+		puz.cage_sums[q] = cage.sum;
+		for(u8 index : cage.cells)
+			puz.cage_of[index] = q;
+	}
+	return puz;
+}
+//Rearranges a puzzle into an equivalent one, with the same solutions and difficulty.
+//    Rows are shuffled within each band and the bands shuffled (columns and stacks likewise),
+//    the grid may be transposed, and the digits relabelled.
+//Killer cage sums would change under relabelling, so killer puzzles only have their cells moved.
+BuiltPuzzle isomorph(BuiltPuzzle const& puz, u64 iso_seed)
+{
+	Xoshiro256 rng(iso_seed);
+	auto shuffle = [&rng](u8* arr, u8 len)
+		{
+			for(u8 q = len-1; q > 0; --q)
+				std::swap(arr[q], arr[rng.below(q+1)]);
+		};
+	u8 rows[9], cols[9]; //source row/column of each row/column
+	for(u8* lines : {rows, cols})
+	{
+		if(puz.diff == DIFF_KILLER)
+		{
+			//Cages must stay connected, so only mirror whole lines; with the transpose
+			//    that gives every rotation and reflection of the grid
+			bool flip = rng() & 1;
+			for(u8 q = 0; q < 9; ++q)
+				lines[q] = flip ? 8-q : q;
+			continue;
+		}
+		u8 bands[3] = {0,1,2};
+		shuffle(bands, 3);
+		for(u8 b = 0; b < 3; ++b)
+		{
+			u8 inner[3] = {0,1,2};
+			shuffle(inner, 3);
+			for(u8 q = 0; q < 3; ++q)
+				lines[3*b+q] = 3*bands[b] + inner[q];
+		}
+	}
+	bool transpose = rng() & 1;
+	u8 digits[10] = {0,1,2,3,4,5,6,7,8,9};
+	if(puz.diff != DIFF_KILLER)
+		shuffle(digits+1, 9);
+	
+	BuiltPuzzle ret = puz; //cage ids and sums carry over
+	ret.iso_seed = iso_seed;
+	ret.givens = CellMask();
+	for(u8 index = 0; index < 9*9; ++index)
+	{
+		u8 row = rows[row_of(index)], col = cols[col_of(index)];
+		u8 src = transpose ? 9*col+row : 9*row+col;
+		ret.set_solution(index, digits[puz.solution(src)]);
+		if(puz.given(src))
+			ret.givens.insert(index);
+		ret.cage_of[index] = puz.cage_of[src];
+	}
+	return ret;
 }
 
 }
@@ -1,22 +1,183 @@
 #pragma once
 
-#include "Main.hpp"
+#include "Core.hpp"
+#include <bit>
+#include <type_traits>
+#include <atomic>
+#include <stop_token>
 
 namespace PuzzleGen
 {
+	// Starts/stops the background pool behind 'request_puzzle'
 	void init();
 	void shutdown();
 	
+	// Which solver checks uniqueness while trimming givens
+	enum SolverBackend
+	{
+		SOLVER_BACKTRACK,
+		SOLVER_DLX,
+		NUM_SOLVERS
+	};
+	void set_solver(SolverBackend s);
+	SolverBackend get_solver();
+	
+	// Generation is reproducible from the base seed (0 picks one from the clock)
+	void set_seed(u64 seed);
+	u64 get_seed();
+	u64 worker_seed(u64 worker);
+	void seed_thread_rng(u64 seed); //reseeds the calling thread's generator
+	
+	// Worker threads generating puzzles in the background (0 uses one per hardware thread)
+	void set_threads(u16 count);
+	u16 get_threads();
+	// Ready queues are sized so a player waits on generation less often than 'chance'
+	void set_wait_chance(double chance);
+	// Fraction of the worker threads' time background generation may use on average
+	void set_cpu_budget(double frac);
+	
+	// Checked throughout generation; throws ignore_exception once the calling thread's build is stopped
+	void check_abort();
+	
+	// Candidate digits for a cell, bit (v-1) set if 'v' is possible
+	#define OPTS_ALL 0x1FF
+	constexpr u16 opt_bit(u8 v)
+	{
+		return u16(1 << (v-1));
+	}
+	constexpr u8 opt_count(u16 opts)
+	{
+		return u8(std::popcount(opts));
+	}
+	constexpr u8 opt_lowest(u16 opts) // 0 if empty
+	{
+		return opts ? u8(std::countr_zero(opts)+1) : 0;
+	}
+	constexpr u8 opt_highest(u16 opts) // 0 if empty
+	{
+		return u8(std::bit_width(opts));
+	}
+	
+	// A set of cell indexes (0-80), stored as an 81-bit mask
+	struct CellMask
+	{
+		u64 lo = 0; // cells 0-63
+		u64 hi = 0; // cells 64-80
+		
+		constexpr CellMask() = default;
+		constexpr CellMask(u64 lo, u64 hi) : lo(lo), hi(hi) {}
+		static constexpr CellMask all()
+		{
+			return CellMask(~0ULL, (1ULL << (81-64))-1);
+		}
+		
+		constexpr bool contains(u8 q) const
+		{
+			return q < 64 ? (lo >> q) & 1 : (hi >> (q-64)) & 1;
+		}
+		constexpr void insert(u8 q)
+		{
+			if(q < 64) lo |= 1ULL << q;
+			else hi |= 1ULL << (q-64);
+		}
+		constexpr void erase(u8 q)
+		{
+			if(q < 64) lo &= ~(1ULL << q);
+			else hi &= ~(1ULL << (q-64));
+		}
+		constexpr void clear()
+		{
+			lo = hi = 0;
+		}
+		constexpr u8 size() const
+		{
+			return u8(std::popcount(lo) + std::popcount(hi));
+		}
+		constexpr bool empty() const
+		{
+			return !(lo|hi);
+		}
+		constexpr u8 first() const // 81 if empty
+		{
+			if(lo) return u8(std::countr_zero(lo));
+			if(hi) return u8(64 + std::countr_zero(hi));
+			return 81;
+		}
+		constexpr u8 nth(u8 n) const // index of the 'n'th (0-based) cell in the set
+		{
+			u64 bits = lo;
+			u8 offs = 0;
+			if(u8 c = u8(std::popcount(lo)); n >= c)
+			{
+				n -= c;
+				bits = hi;
+				offs = 64;
+			}
+			for(; n; --n)
+				bits &= bits-1;
+			return u8(offs + std::countr_zero(bits));
+		}
+		
+		constexpr CellMask operator|(CellMask const& o) const {return {lo|o.lo, hi|o.hi};}
+		constexpr CellMask operator&(CellMask const& o) const {return {lo&o.lo, hi&o.hi};}
+		constexpr CellMask operator-(CellMask const& o) const {return {lo&~o.lo, hi&~o.hi};}
+		constexpr CellMask& operator|=(CellMask const& o) {lo |= o.lo; hi |= o.hi; return *this;}
+		constexpr CellMask& operator&=(CellMask const& o) {lo &= o.lo; hi &= o.hi; return *this;}
+		constexpr CellMask& operator-=(CellMask const& o) {lo &= ~o.lo; hi &= ~o.hi; return *this;}
+		constexpr bool operator==(CellMask const& o) const = default;
+		
+		struct iterator
+		{
+			u64 lo, hi;
+			constexpr u8 operator*() const
+			{
+				return lo ? u8(std::countr_zero(lo)) : u8(64 + std::countr_zero(hi));
+			}
+			constexpr iterator& operator++()
+			{
+				if(lo) lo &= lo-1;
+				else hi &= hi-1;
+				return *this;
+			}
+			constexpr bool operator!=(iterator const& o) const
+			{
+				return lo != o.lo || hi != o.hi;
+			}
+		};
+		constexpr iterator begin() const {return {lo, hi};}
+		constexpr iterator end() const {return {0, 0};}
+	};
+	
+	// A finished puzzle, as handed to the game. Fixed-size and trivially copyable,
+	//     so it passes through the queues without touching the heap.
 	struct BuiltPuzzle
 	{
-		vector<pair<u8,bool>> cells;
-		vector<set<u8>> cages;
+		u64 seed; //same seed and difficulty always build this exact puzzle
+		u64 iso_seed; //if nonzero, the puzzle was then transformed by 'isomorph(puz, iso_seed)'
+		Difficulty diff;
+		CellMask givens;
+		u8 packed_sol[(9*9+1)/2]; //two cells per byte, even index in the low nibble
+		u8 num_cages;
+		u8 cage_of[9*9]; //cage id of each cell, or NO_CAGE
+		u8 cage_sums[9*9];
+		
+		constexpr u8 solution(u8 index) const
+		{
+			return (packed_sol[index/2] >> (4*(index%2))) & 0xF;
+		}
+		constexpr void set_solution(u8 index, u8 val)
+		{
+			u8& b = packed_sol[index/2];
+			b = (b & ~(0xF << (4*(index%2)))) | (val << (4*(index%2)));
+		}
+		constexpr bool given(u8 index) const {return givens.contains(index);}
 	};
+	static_assert(std::is_trivially_copyable_v<BuiltPuzzle>);
 	struct Cage
 	{
 		u8 sum;
-		set<u8> cells;
-		set<u8> get_neighbors() const;
+		CellMask cells;
+		CellMask get_neighbors() const;
 	};
 	struct PuzzleCell
 	{
@@ -25,19 +186,49 @@ namespace PuzzleGen
 		bool given;
 		Cage const* cage;
 		
-		set<u8> options;
+		u16 options;
 		void clear();
-		void reset_opts();
 		PuzzleCell();
 	};
+	// Human solving techniques, easiest first
+	enum Technique
+	{
+		TECH_NONE,
+		TECH_NAKED_SINGLE,
+		TECH_HIDDEN_SINGLE,
+		TECH_CAGE, //killer cage combinations
+		TECH_LOCKED_CANDIDATES,
+		TECH_NAKED_PAIR,
+		TECH_HIDDEN_PAIR,
+		TECH_NAKED_TRIPLE,
+		TECH_HIDDEN_TRIPLE,
+		TECH_X_WING,
+		TECH_CHAIN, //simple colouring
+		TECH_GUESS, //stuck without search
+		NUM_TECHS
+	};
+	char const* technique_name(Technique t);
+	// How hard a puzzle is to solve by hand
+	struct LogicGrade
+	{
+		Technique hardest;
+		u16 steps;
+		u32 score; //sum of each step's technique weight
+		bool solved; //false if it needs guessing (or past the allowed techniques)
+	};
 	struct PuzzleGrid
 	{
 		PuzzleCell cells[9*9];
 		vector<Cage> cages;
-		PuzzleGrid(Difficulty d);
+		PuzzleGrid(Difficulty d, std::stop_token stop = {}); //throws ignore_exception if stopped
+		PuzzleGrid(BuiltPuzzle const& puz);
+		PuzzleGrid(u8 const (&digits)[9*9]); //givens only, 0 for blank
 		
 		static PuzzleGrid given_copy(PuzzleGrid const& g);
 		bool is_unique() const;
+		u32 solve_effort() const; //placements the solver needs to prove the solution unique
+		LogicGrade grade(Technique max_tech = TECH_CHAIN) const; //solves the givens using techniques up to 'max_tech'
+		bool singles_solvable() const; //naked and hidden singles alone solve the givens, so the solution is unique
 		void print() const;
 		void print_cages() const;
 		void print_sol() const;
@@ -47,13 +238,102 @@ namespace PuzzleGen
 		void clear();
 		void clear_cages();
 		
-		pair<set<u8>,u8> trim_opts(map<u8,set<u8>> const& banned);
 		bool solve(bool check_unique);
+		static bool solve_cells(PuzzleCell* cells, vector<Cage> const& cages, bool check_unique);
+		bool is_unique_dlx() const;
+		bool forced_by_givens(u8 index) const;
 		void populate();
 		void killer_fill();
 		void build(Difficulty d);
+		
+		friend bool solve_grid(u8 (&digits)[9*9]);
+		friend struct GenBench; //bench/GenBench.cpp times the private steps
+	};
+	// Plain grids, 0 for blank
+	bool solve_grid(u8 (&digits)[9*9]); //fills in the blanks; false if there's no solution
+	bool unique_grid(u8 const (&digits)[9*9]);
+	LogicGrade grade_puzzle(BuiltPuzzle const& puz);
+	
+	// Work done generating, to see where a slow build spends its time
+	struct GenStats
+	{
+		u64 puzzles = 0; //builds completed
+		u64 abandoned = 0; //builds aborted, or that failed
+		u64 nodes = 0; //values placed by the solvers
+		u64 backtracks = 0; //dead ends the solvers had to step back from
+		u64 unique_calls = 0;
+		u64 unique_fails = 0; //uniqueness checks finding a second solution (or none)
+		u64 logic_accepts = 0; //removals proven unique by singles, skipping the uniqueness check
+		u64 cage_fills = 0; //'killer_fill' calls
+		u64 cage_exhausted = 0; //steps that ran out of cage fill attempts and backtracked
+		u64 restarts = 0; //builds started over from the full grid, after failing or (hard/killer) running over budget
+		u64 regrades = 0; //finished grids thrown out for grading outside the difficulty's band
+		
+		GenStats& operator+=(GenStats const& o);
+		string describe() const;
+	};
+	GenStats& thread_stats(); //counts for the build running on the calling thread
+	GenStats get_stats(Difficulty d); //totals of every 'build_puzzle' since launch
+	void log_stats(); //logs each difficulty's totals, verbose only
+	
+	BuiltPuzzle build_puzzle(Difficulty d, u64 seed, std::stop_token stop = {}); //generates on the calling thread
+	BuiltPuzzle isomorph(BuiltPuzzle const& puz, u64 iso_seed);
+	// Where a requested puzzle lands; the caller owns it, so a request needs no heap.
+	//     Destroying a ticket that's still pending withdraws its request.
+	struct PuzzleTicket
+	{
+		PuzzleTicket() = default;
+		PuzzleTicket(PuzzleTicket const&) = delete;
+		PuzzleTicket& operator=(PuzzleTicket const&) = delete;
+		~PuzzleTicket();
+		
+		bool ready() const; //true once 'get' won't block
+		BuiltPuzzle get(); //blocks until ready; throws ignore_exception if the request was broken
+	private:
+		friend struct PuzzleGenFactory;
+		enum : u8 {TICKET_IDLE, TICKET_PENDING, TICKET_READY, TICKET_BROKEN};
+		std::atomic<u8> state = TICKET_IDLE;
+		Difficulty diff = DIFF_EASY;
+		PuzzleTicket* next = nullptr; //in the pool's list of waiting requests
+		u64 order = 0; //when it started waiting, so the pool can serve the oldest first
+		BuiltPuzzle puz;
+		
+		void fill(BuiltPuzzle const& p);
+		void fail();
+	};
+	// Requests the next puzzle from the bank or the pool into 'ticket', which must not be pending.
+	//     Ready at once if one is stocked, else as soon as a worker builds one, with the whole
+	//     pool switched over to it; broken if the pool shuts down first.
+	void request_puzzle(Difficulty d, PuzzleTicket& ticket);
+	// Called on a worker thread whenever the pool finishes a puzzle
+	void set_on_ready(std::function<void(Difficulty)> callback);
+	BuiltPuzzle gen_puzzle(Difficulty d, optional<u64> seed = nullopt); //blocks on 'request_puzzle' if unseeded
+	
+	// Where the puzzle cache and bank state are kept; the game points it at APSudoku.cfg's folder
+	void set_data_dir(string const& dir); //default: the working directory
+	string data_path(string const& fname);
+	
+	// Unserved puzzles, saved on shutdown and reloaded on launch
+	bool save_cache(string const& fname, vector<BuiltPuzzle> const& puzzles);
+	vector<BuiltPuzzle> load_cache(string const& fname); //empty if missing or invalid
+	
+	// A read-only, memory-mapped bank of pre-generated puzzles, served without repeats
+	void set_bank(string const& fname); //opened on 'init', if not empty
+	bool open_bank(string const& fname);
+	void close_bank();
+	bool bank_has(Difficulty d);
+	optional<BuiltPuzzle> draw_bank(Difficulty d, u16 min_rating = 0, u16 max_rating = 0xFFFF);
+	// Builds a bank file; each puzzle is rated by the solver effort it takes
+	struct BankWriter
+	{
+		BankWriter();
+		~BankWriter();
+		void add(BuiltPuzzle const& puz);
+		bool write(string const& fname);
+	private:
+		struct Entry;
+		vector<Entry> entries;
 	};
-	BuiltPuzzle gen_puzzle(Difficulty d);
 	
 	class puzzle_gen_exception : public sudoku_exception
 	{
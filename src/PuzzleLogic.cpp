@@ -0,0 +1,547 @@
+#include "PuzzleGen.hpp"
+#include "GridTables.hpp"
+
+namespace PuzzleGen
+{
+using namespace GridTables;
+
+static char const* tech_names[NUM_TECHS] = {"None","Naked Single","Hidden Single","Cage Combination",
+	"Locked Candidates","Naked Pair","Hidden Pair","Naked Triple","Hidden Triple","X-Wing",
+	"Simple Colouring","Guess"};
+//Added to a puzzle's score each time a technique is used
+static const u8 tech_weights[NUM_TECHS] = {0, 1, 2, 3, 5, 10, 12, 15, 18, 25, 35, 100};
+char const* technique_name(Technique t)
+{
+	return t < NUM_TECHS ? tech_names[t] : "";
+}
+
+//Solves the way a person would: candidates only ever shrink, and each step is the
+//    easiest technique that makes progress. No search, so it stops if it gets stuck.
+struct LogicSolver
+{
+	LogicSolver(PuzzleGrid const& grid);
+	LogicGrade solve(Technique max_tech);
+	bool solve_singles();
+private:
+	u16 cand[9*9]; //options of each unsolved cell, 0 once solved
+	u8 val[9*9];
+	u8 left; //cells still unsolved
+	bool broken; //some cell ran out of options; the givens have no solution
+	
+	u8 num_cages;
+	u8 cage_of[9*9]; //NO_CAGE if uncaged
+	CellMask cage_cells[9*9];
+	u8 cage_sum_left[9*9];
+	u8 cage_cells_left[9*9];
+	
+	void place(u8 index, u8 v);
+	bool eliminate(u8 index, u16 bits);
+	Technique step(Technique max_tech);
+	
+	bool naked_single();
+	bool hidden_single();
+	bool cage_combination();
+	bool locked_candidates();
+	bool naked_subset(u8 n);
+	bool hidden_subset(u8 n);
+	bool x_wing();
+	bool simple_colouring();
+};
+
+LogicSolver::LogicSolver(PuzzleGrid const& grid)
+	: left(9*9), broken(false), num_cages(grid.cages.size())
+{
+	//Givens first, by unit masks; far cheaper than placing each one through its peers
+	u16 used[NUM_UNITS] = {0};
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		cand[q] = 0;
+		val[q] = 0;
+		cage_of[q] = NO_CAGE;
+		PuzzleCell const& cell = grid.cells[q];
+		if(!cell.given)
+			continue;
+		u16 bit = opt_bit(cell.sol);
+		for(u8 u : cell_units[q])
+		{
+			if(used[u] & bit) //clashes with another given
+				broken = true;
+			used[u] |= bit;
+		}
+		val[q] = cell.sol;
+		--left;
+	}
+	for(u8 q = 0; q < 9*9; ++q)
+		if(!val[q])
+		{
+			auto const& cu = cell_units[q];
+			cand[q] = OPTS_ALL & ~(used[cu[0]] | used[cu[1]] | used[cu[2]]);
+			if(!cand[q])
+				broken = true;
+		}
+	for(u8 c = 0; c < num_cages; ++c)
+	{
+		Cage const& cage = grid.cages[c];
+		cage_cells[c] = cage.cells;
+		cage_sum_left[c] = cage.sum;
+		cage_cells_left[c] = cage.cells.size();
+		for(u8 q : cage.cells)
+			cage_of[q] = c;
+		for(u8 q : cage.cells)
+			if(val[q])
+			{
+				cage_sum_left[c] -= val[q];
+				--cage_cells_left[c];
+				for(u8 p : cage.cells)
+					eliminate(p, opt_bit(val[q]));
+			}
+	}
+}
+void LogicSolver::place(u8 index, u8 v)
+{
+	u16 bit = opt_bit(v);
+	val[index] = v;
+	cand[index] = 0;
+	--left;
+	for(u8 p : peers[index])
+		eliminate(p, bit);
+	u8 c = cage_of[index];
+	if(c != NO_CAGE)
+	{
+		for(u8 q : cage_cells[c])
+			eliminate(q, bit);
+		cage_sum_left[c] -= v;
+		--cage_cells_left[c];
+	}
+}
+//Removes 'bits' from an unsolved cell's options, returning if any were there
+bool LogicSolver::eliminate(u8 index, u16 bits)
+{
+	if(val[index] || !(cand[index] & bits))
+		return false;
+	cand[index] &= ~bits;
+	if(!cand[index])
+		broken = true;
+	return true;
+}
+
+bool LogicSolver::naked_single()
+{
+	for(u8 q = 0; q < 9*9; ++q)
+		if(!val[q] && opt_count(cand[q]) == 1)
+		{
+			place(q, opt_lowest(cand[q]));
+			return true;
+		}
+	return false;
+}
+bool LogicSolver::hidden_single()
+{
+	for(auto const& unit : units)
+	{
+		u16 once = 0, twice = 0;
+		for(u8 q : unit)
+		{
+			twice |= once & cand[q];
+			once |= cand[q];
+		}
+		if(u16 single = once & ~twice)
+		{
+			u16 bit = single & -single;
+			for(u8 q : unit)
+				if(cand[q] & bit)
+				{
+					place(q, opt_lowest(bit));
+					return true;
+				}
+		}
+	}
+	return false;
+}
+//Keeps only the digits that fit some combination adding up to a cage's remaining sum
+bool LogicSolver::cage_combination()
+{
+	bool ret = false;
+	for(u8 c = 0; c < num_cages; ++c)
+	{
+		if(!cage_cells_left[c])
+			continue;
+		u16 avail = 0;
+		for(u8 q : cage_cells[c])
+			avail |= cand[q];
+		u16 valid = 0;
+		for(u16 combo : cage_combos_for(cage_cells_left[c], cage_sum_left[c]))
+		{
+			if((combo & avail) != combo)
+				continue;
+			bool fits = true;
+			for(u8 q : cage_cells[c])
+				if(!val[q] && !(cand[q] & combo))
+					fits = false;
+			if(fits)
+				valid |= combo;
+		}
+		for(u8 q : cage_cells[c])
+			ret |= eliminate(q, ~valid & OPTS_ALL);
+	}
+	return ret;
+}
+//A digit confined to one line within a box can't be elsewhere on that line ("pointing"),
+//    and one confined to one box within a line can't be elsewhere in that box ("claiming")
+bool LogicSolver::locked_candidates()
+{
+	//Options of the 3 cells where each line crosses each box, as [line][box along it]
+	u16 segs[2][9][3] = {};
+	for(u8 q = 0; q < 9*9; ++q)
+	{
+		segs[0][row_of(q)][col_of(q)/3] |= cand[q];
+		segs[1][col_of(q)][row_of(q)/3] |= cand[q];
+	}
+	for(u8 dir = 0; dir < 2; ++dir)
+		for(u8 line = 0; line < 9; ++line)
+			for(u8 seg = 0; seg < 3; ++seg)
+			{
+				u16 here = segs[dir][line][seg];
+				if(!here)
+					continue;
+				u8 band = line/3*3; //first line through the same box
+				u16 rest_of_box = segs[dir][band + (line+1)%3][seg] | segs[dir][band + (line+2)%3][seg];
+				u16 rest_of_line = segs[dir][line][(seg+1)%3] | segs[dir][line][(seg+2)%3];
+				u16 pointing = here & ~rest_of_box & rest_of_line;
+				u16 claiming = here & ~rest_of_line & rest_of_box;
+				if(!pointing && !claiming)
+					continue;
+				bool ret = false;
+				for(u8 q = 0; q < 9*9; ++q)
+				{
+					u8 q_line = dir ? col_of(q) : row_of(q);
+					u8 q_seg = (dir ? row_of(q) : col_of(q)) / 3;
+					if(q_line == line && q_seg != seg)
+						ret |= eliminate(q, pointing);
+					else if(q_line != line && q_line/3*3 == band && q_seg == seg)
+						ret |= eliminate(q, claiming);
+				}
+				if(ret)
+					return true;
+			}
+	return false;
+}
+//'n' cells of a unit that between them hold only 'n' digits; those digits leave the other cells
+bool LogicSolver::naked_subset(u8 n)
+{
+	for(auto const& unit : units)
+	{
+		u8 open[9];
+		u8 count = 0, unsolved = 0;
+		for(u8 q : unit)
+			if(!val[q])
+			{
+				++unsolved;
+				if(opt_count(cand[q]) <= n)
+					open[count++] = q;
+			}
+		if(count < n || unsolved <= n)
+			continue;
+		//Every combination of 'n' of the open cells, as a bitmask over 'open'
+		for(u16 pick = 0; pick < (1 << count); ++pick)
+		{
+			if(std::popcount(pick) != n)
+				continue;
+			u16 digits = 0;
+			u16 chosen = 0;
+			for(u8 i = 0; i < count; ++i)
+				if(pick & (1 << i))
+				{
+					digits |= cand[open[i]];
+					chosen |= 1 << i;
+				}
+			if(opt_count(digits) != n)
+				continue;
+			bool ret = false;
+			for(u8 q : unit)
+			{
+				bool in_subset = false;
+				for(u8 i = 0; i < count; ++i)
+					if((chosen & (1 << i)) && open[i] == q)
+						in_subset = true;
+				if(!in_subset)
+					ret |= eliminate(q, digits);
+			}
+			if(ret)
+				return true;
+		}
+	}
+	return false;
+}
+//'n' digits confined to the same 'n' cells of a unit; those cells can't hold anything else
+bool LogicSolver::hidden_subset(u8 n)
+{
+	for(auto const& unit : units)
+	{
+		u16 where[9] = {0}; //slots of the unit each digit can go in
+		u16 open_digits = 0;
+		for(u8 i = 0; i < 9; ++i)
+			for(u16 opts = cand[unit[i]]; opts; opts &= opts-1)
+			{
+				u8 v = opt_lowest(opts);
+				where[v-1] |= 1 << i;
+				open_digits |= opt_bit(v);
+			}
+		//Only digits with 2 to 'n' places can be part of the subset
+		u16 fits = 0;
+		for(u8 v = 1; v <= 9; ++v)
+			if(u8 places = std::popcount(where[v-1]); places >= 2 && places <= n)
+				fits |= opt_bit(v);
+		if(opt_count(open_digits) <= n || opt_count(fits) < n)
+			continue;
+		for(u16 digits = fits; digits; digits = (digits-1) & fits)
+		{
+			if(std::popcount(digits) != n)
+				continue;
+			u16 slots = 0;
+			for(u8 v = 1; v <= 9; ++v)
+				if(digits & opt_bit(v))
+					slots |= where[v-1];
+			if(std::popcount(slots) != n)
+				continue;
+			bool ret = false;
+			for(u8 i = 0; i < 9; ++i)
+				if(slots & (1 << i))
+					ret |= eliminate(unit[i], OPTS_ALL & ~digits);
+			if(ret)
+				return true;
+		}
+	}
+	return false;
+}
+//A digit with exactly two places in each of two rows, in the same two columns, must take
+//    one of the two columns in each; it can't be elsewhere in those columns (and vice versa)
+bool LogicSolver::x_wing()
+{
+	for(u8 v = 1; v <= 9; ++v)
+	{
+		u16 bit = opt_bit(v);
+		for(u8 by_col = 0; by_col < 2; ++by_col)
+		{
+			u16 lines[9] = {0}; //positions along each line
+			for(u8 q = 0; q < 9*9; ++q)
+				if(cand[q] & bit)
+				{
+					u8 line = by_col ? col_of(q) : row_of(q);
+					u8 pos = by_col ? row_of(q) : col_of(q);
+					lines[line] |= 1 << pos;
+				}
+			for(u8 a = 0; a < 9; ++a)
+			{
+				if(std::popcount(lines[a]) != 2)
+					continue;
+				for(u8 b = a+1; b < 9; ++b)
+				{
+					if(lines[b] != lines[a])
+						continue;
+					bool ret = false;
+					for(u8 q = 0; q < 9*9; ++q)
+					{
+						u8 line = by_col ? col_of(q) : row_of(q);
+						u8 pos = by_col ? row_of(q) : col_of(q);
+						if(line != a && line != b && (lines[a] & (1 << pos)))
+							ret |= eliminate(q, bit);
+					}
+					if(ret)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+//Links cells where a digit has exactly two places in a unit; along a chain of such links
+//    the digit alternates, so the cells split into two colours, one of which is all true.
+//    Same colour twice in a unit: that colour is false. A cell seeing both colours: not there.
+bool LogicSolver::simple_colouring()
+{
+	for(u8 v = 1; v <= 9; ++v)
+	{
+		u16 bit = opt_bit(v);
+		u8 links[9*9][3]; //at most one link per unit
+		u8 num_links[9*9] = {0};
+		bool any = false;
+		for(auto const& unit : units)
+		{
+			u8 found[2];
+			u8 count = 0;
+			for(u8 q : unit)
+				if((cand[q] & bit) && count++ < 2)
+					found[count-1] = q;
+			if(count == 2)
+			{
+				links[found[0]][num_links[found[0]]++] = found[1];
+				links[found[1]][num_links[found[1]]++] = found[0];
+				any = true;
+			}
+		}
+		if(!any)
+			continue;
+		CellMask seen;
+		for(u8 start = 0; start < 9*9; ++start)
+		{
+			if(!num_links[start] || seen.contains(start))
+				continue;
+			CellMask colour[2];
+			u8 stack[9*9];
+			u8 depth = 0;
+			colour[0].insert(start);
+			seen.insert(start);
+			stack[depth++] = start;
+			while(depth)
+			{
+				u8 q = stack[--depth];
+				u8 c = colour[1].contains(q);
+				for(u8 l = 0; l < num_links[q]; ++l)
+					if(u8 next = links[q][l]; !seen.contains(next))
+					{
+						seen.insert(next);
+						colour[!c].insert(next);
+						stack[depth++] = next;
+					}
+			}
+			if(colour[0].size() + colour[1].size() < 4)
+				continue; //a single link; nothing follows from it
+			auto sees = [](u8 q, CellMask const& m)
+				{
+					for(u8 p : peers[q])
+						if(m.contains(p))
+							return true;
+					return false;
+				};
+			for(u8 c = 0; c < 2; ++c)
+			{
+				bool wrap = false;
+				for(u8 q : colour[c])
+					if(sees(q, colour[c]))
+						wrap = true;
+				if(wrap)
+				{
+					bool ret = false;
+					for(u8 q : colour[c])
+						ret |= eliminate(q, bit);
+					if(ret)
+						return true;
+				}
+			}
+			bool ret = false;
+			for(u8 q = 0; q < 9*9; ++q)
+				if((cand[q] & bit) && !colour[0].contains(q) && !colour[1].contains(q)
+					&& sees(q, colour[0]) && sees(q, colour[1]))
+					ret |= eliminate(q, bit);
+			if(ret)
+				return true;
+		}
+	}
+	return false;
+}
+
+//Applies the easiest technique that makes progress, returning it (or NUM_TECHS if stuck)
+Technique LogicSolver::step(Technique max_tech)
+{
+	if(naked_single())
+		return TECH_NAKED_SINGLE;
+	if(max_tech >= TECH_HIDDEN_SINGLE && hidden_single())
+		return TECH_HIDDEN_SINGLE;
+	if(max_tech >= TECH_CAGE && num_cages && cage_combination())
+		return TECH_CAGE;
+	if(max_tech >= TECH_LOCKED_CANDIDATES && locked_candidates())
+		return TECH_LOCKED_CANDIDATES;
+	if(max_tech >= TECH_NAKED_PAIR && naked_subset(2))
+		return TECH_NAKED_PAIR;
+	if(max_tech >= TECH_HIDDEN_PAIR && hidden_subset(2))
+		return TECH_HIDDEN_PAIR;
+	if(max_tech >= TECH_NAKED_TRIPLE && naked_subset(3))
+		return TECH_NAKED_TRIPLE;
+	if(max_tech >= TECH_HIDDEN_TRIPLE && hidden_subset(3))
+		return TECH_HIDDEN_TRIPLE;
+	if(max_tech >= TECH_X_WING && x_wing())
+		return TECH_X_WING;
+	if(max_tech >= TECH_CHAIN && simple_colouring())
+		return TECH_CHAIN;
+	return NUM_TECHS;
+}
+LogicGrade LogicSolver::solve(Technique max_tech)
+{
+	LogicGrade ret{TECH_NONE, 0, 0, false};
+	while(left && !broken)
+	{
+		check_abort();
+		Technique t = step(max_tech);
+		if(t == NUM_TECHS)
+			break;
+		++ret.steps;
+		ret.score += tech_weights[t];
+		if(t > ret.hardest)
+			ret.hardest = t;
+	}
+	ret.solved = !left && !broken;
+	if(!ret.solved)
+	{
+		ret.hardest = TECH_GUESS;
+		ret.score += tech_weights[TECH_GUESS];
+	}
+	return ret;
+}
+
+//Places every naked and hidden single in bulk, until none are left; no grading,
+//    just the fastest way to learn if singles alone finish the puzzle
+bool LogicSolver::solve_singles()
+{
+	bool progress = true;
+	while(left && !broken && progress)
+	{
+		check_abort();
+		progress = false;
+		for(u8 q = 0; q < 9*9; ++q)
+			if(!val[q] && opt_count(cand[q]) == 1)
+			{
+				place(q, opt_lowest(cand[q]));
+				progress = true;
+			}
+		for(auto const& unit : units)
+		{
+			u16 once = 0, twice = 0;
+			for(u8 q : unit)
+			{
+				twice |= once & cand[q];
+				once |= cand[q];
+			}
+			for(u16 singles = once & ~twice; singles; singles &= singles-1)
+			{
+				u16 bit = singles & -singles;
+				for(u8 q : unit)
+					if(cand[q] & bit)
+					{
+						place(q, opt_lowest(bit));
+						progress = true;
+						break;
+					}
+			}
+		}
+	}
+	return !left && !broken;
+}
+
+LogicGrade PuzzleGrid::grade(Technique max_tech) const
+{
+	LogicSolver solver(*this);
+	return solver.solve(max_tech);
+}
+bool PuzzleGrid::singles_solvable() const
+{
+	LogicSolver solver(*this);
+	return solver.solve_singles();
+}
+LogicGrade grade_puzzle(BuiltPuzzle const& puz)
+{
+	return PuzzleGrid(puz).grade();
+}
+
+}
+
@@ -0,0 +1,111 @@
+#include "PuzzleSimd.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define SIMD_X86
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define TARGET_SSE2
+	#else
+		#define TARGET_SSE2 __attribute__((target("sse2")))
+	#endif
+#endif
+
+namespace PuzzleSimd
+{
+
+static const u16 ALL_OPTS = 0x1FF;
+
+static void eliminate_scalar(u16 const* unit_vals, u16* opts)
+{
+	u16 const* cols = unit_vals+9;
+	u16 const* boxes = unit_vals+18;
+	for(u8 row = 0; row < 9; ++row)
+	{
+		u16 const* band = boxes + 3*(row/3);
+		for(u8 col = 0; col < 9; ++col)
+			opts[9*row+col] = ALL_OPTS & ~(unit_vals[row] | cols[col] | band[col/3]);
+	}
+}
+
+#ifdef SIMD_X86
+// Each row is 8 lanes of vector (columns 0-7) plus a scalar tail (column 8).
+//     Column masks are the same for every row, box masks the same for every row in a band.
+TARGET_SSE2 static void eliminate_sse2(u16 const* unit_vals, u16* opts)
+{
+	u16 const* cols = unit_vals+9;
+	u16 const* boxes = unit_vals+18;
+	__m128i all = _mm_set1_epi16(ALL_OPTS);
+	__m128i colv = _mm_loadu_si128((__m128i const*)cols);
+	for(u8 b = 0; b < 3; ++b)
+	{
+		u16 const* band = boxes + 3*b;
+		__m128i seen = _mm_or_si128(colv, _mm_setr_epi16(band[0], band[0], band[0],
+			band[1], band[1], band[1], band[2], band[2]));
+		for(u8 row = 3*b; row < 3*b+3; ++row)
+		{
+			__m128i v = _mm_or_si128(seen, _mm_set1_epi16(unit_vals[row]));
+			_mm_storeu_si128((__m128i*)(opts + 9*row), _mm_andnot_si128(v, all));
+			opts[9*row+8] = ALL_OPTS & ~(unit_vals[row] | cols[8] | band[2]);
+		}
+	}
+}
+static bool cpu_has_sse2()
+{
+	#if defined(__x86_64__) || defined(_M_X64)
+	return true; //always part of x86-64
+	#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1<<26)) != 0;
+	#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+	#endif
+}
+#endif
+
+SimdLevel simd_level()
+{
+	#ifdef SIMD_X86
+	static const SimdLevel lvl = cpu_has_sse2() ? SIMD_SSE2 : SIMD_SCALAR;
+	return lvl;
+	#else
+	return SIMD_SCALAR;
+	#endif
+}
+char const* simd_name(SimdLevel lvl)
+{
+	switch(lvl)
+	{
+		case SIMD_SCALAR:
+			return "scalar";
+		case SIMD_SSE2:
+			return "sse2";
+		case NUM_SIMD:
+			break;
+	}
+	return "";
+}
+
+void eliminate(SimdLevel lvl, u16 const* unit_vals, u16* opts)
+{
+	switch(lvl)
+	{
+		#ifdef SIMD_X86
+		case SIMD_SSE2:
+			eliminate_sse2(unit_vals, opts);
+			return;
+		#endif
+		default:
+			eliminate_scalar(unit_vals, opts);
+			return;
+	}
+}
+void eliminate(u16 const* unit_vals, u16* opts)
+{
+	static const SimdLevel lvl = simd_level();
+	eliminate(lvl, unit_vals, opts);
+}
+
+}
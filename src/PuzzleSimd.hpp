@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Types.hpp"
+
+// Vectorized candidate elimination for the generator, picked at runtime by CPU support
+namespace PuzzleSimd
+{
+	enum SimdLevel
+	{
+		SIMD_SCALAR,
+		SIMD_SSE2,
+		NUM_SIMD
+	};
+	SimdLevel simd_level(); //best level the running CPU supports
+	char const* simd_name(SimdLevel lvl);
+	
+	// Computes every cell's candidate mask from the values placed in its units
+	//     opts[index] = 0x1FF & ~(unit_vals[row] | unit_vals[col] | unit_vals[box])
+	// 'unit_vals' is indexed as GridTables' units (rows, then columns, then boxes)
+	void eliminate(u16 const* unit_vals, u16* opts);
+	void eliminate(SimdLevel lvl, u16 const* unit_vals, u16* opts);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Types.hpp"
+
+// SplitMix64, used to expand a single seed into well-mixed state
+constexpr u64 splitmix64(u64& state)
+{
+	u64 z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// xoshiro256** (Blackman & Vigna), a small fast generator.
+//     Identical output for a given seed on every platform, unlike std:: distributions.
+struct Xoshiro256
+{
+	constexpr Xoshiro256(u64 seed = 0)
+	{
+		reseed(seed);
+	}
+	constexpr void reseed(u64 seed)
+	{
+		for(u64& v : s)
+			v = splitmix64(seed);
+	}
+	constexpr u64 operator()()
+	{
+		u64 ret = rotl(s[1] * 5, 7) * 9;
+		u64 t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return ret;
+	}
+	// Uniform in [0,range), rejecting the biased low values
+	constexpr u64 below(u64 range)
+	{
+		if(range < 2)
+			return 0;
+		u64 threshold = (0 - range) % range;
+		u64 v;
+		do v = (*this)();
+		while(v < threshold);
+		return v % range;
+	}
+	// Uniform in [min,max]
+	constexpr u64 between(u64 min, u64 max)
+	{
+		if(max < min)
+			std::swap(min,max);
+		return min + below(max-min+1);
+	}
+private:
+	u64 s[4];
+	static constexpr u64 rotl(u64 x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+};
@@ -1,5 +1,34 @@
 #include "SudokuGrid.hpp"
 #include "PuzzleGen.hpp"
+#include "GridTables.hpp"
+
+static_assert(DIR_UP == 0 && DIR_DOWN == 1 && DIR_LEFT == 2 && DIR_RIGHT == 3,
+	"GridTables::adjacent is indexed by direction");
+
+//Takes the next puzzle, showing a popup while the generator catches up
+static PuzzleGen::BuiltPuzzle wait_puzzle(Difficulty d)
+{
+	PuzzleGen::PuzzleTicket ticket;
+	PuzzleGen::request_puzzle(d, ticket);
+	auto pending = [&ticket]()
+		{
+			return !ticket.ready();
+		};
+	if(pending())
+	{
+		optional<u8> _ret;
+		bool _foo;
+		Dialog popup;
+		popups.emplace_back(&popup);
+		generate_popup(popup, _ret, _foo, "Please Wait", "Generating puzzle...", {});
+		popup.run_proc = pending;
+		popup.run_loop();
+		popups.pop_back();
+	}
+	if(!program_running)
+		throw ignore_exception();
+	return ticket.get();
+}
 
 namespace Sudoku
 {
@@ -298,33 +327,9 @@ namespace Sudoku
 					continue;
 				if(c.flags & CFL_GIVEN)
 					continue;
-				u8 row = (q/9);
-				u8 col = (q%9);
-				for(u8 ind = 0; ind < 9; ++ind) //same row
-				{
-					Cell& other = cells[ind + (row*9)];
-					if(&other == &c) continue;
-					if(other.val == c.val)
-					{
-						c.flags |= CFL_INVALID;
-						other.flags |= CFL_INVALID;
-					}
-				}
-				for(u8 ind = 0; ind < 9; ++ind) //same col
+				for(u8 ind : GridTables::peers[q]) //same row/col/box
 				{
-					Cell& other = cells[col + (ind*9)];
-					if(&other == &c) continue;
-					if(other.val == c.val)
-					{
-						c.flags |= CFL_INVALID;
-						other.flags |= CFL_INVALID;
-					}
-				}
-				u8 bcol = col - (col%3), brow = row - (row%3);
-				for(u8 ind = 0; ind < 9; ++ind) //same box
-				{
-					Cell& other = cells[(bcol + (ind%3)) + (brow + (ind/3))*9];
-					if(&other == &c) continue;
+					Cell& other = cells[ind];
 					if(other.val == c.val)
 					{
 						c.flags |= CFL_INVALID;
@@ -342,9 +347,14 @@ namespace Sudoku
 			exit();
 		for(Cell& c : cells)
 			c.clear();
-		cages.clear();
+		clear_cages();
 		_invalid = false;
 	}
+	void Grid::clear_cages()
+	{
+		num_cages = 0;
+		memset(cage_of, NO_CAGE, sizeof(cage_of));
+	}
 	void Grid::exit()
 	{
 		_active = false;
@@ -397,24 +407,22 @@ namespace Sudoku
 			scale_pos(X,Y,W,H);
 			al_draw_rectangle(X, Y, X+W-1, Y+H-1, Color(C_REGION_BORDER), 2);
 		}
-		for(u8 cindx = 0; cindx < cages.size(); ++cindx) // cage borders/sums
+		for(u8 cindx = 0; cindx < num_cages; ++cindx) // cage borders/sums
 		{
-			auto& cage = cages[cindx];
-			assert(!cage.empty());
 			optional<u8> ul;
 			static const u8 CAGE_PAD = 2;
-			for(u8 q : cage)
+			for(u8 q = 0; q < CELL_COUNT; ++q)
 			{
+				if(cage_of[q] != cindx)
+					continue;
 				if(!ul) ul = q; //top-left cell
 				u8 borders = 0;
-				if(q-9 < 0 || !cage.contains(q-9))
-					borders |= 1<<DIR_UP;
-				if(q+9 >= 81 || !cage.contains(q+9))
-					borders |= 1<<DIR_DOWN;
-				if(!(q%9) || !cage.contains(q-1))
-					borders |= 1<<DIR_LEFT;
-				if(q%9==8 || !cage.contains(q+1))
-					borders |= 1<<DIR_RIGHT;
+				for(u8 dir = DIR_UP; dir <= DIR_RIGHT; ++dir)
+				{
+					u8 adj = GridTables::adjacent[q][dir];
+					if(adj == NO_CELL || cage_of[adj] != cindx)
+						borders |= 1<<dir;
+				}
 				if(borders)
 				{
 					u16 X = x + ((q%9)*CELL_SZ) + CAGE_PAD,
@@ -448,6 +456,7 @@ namespace Sudoku
 					}
 				}
 			}
+			assert(ul);
 			u8 q = *ul;
 			{
 				u16 X = x + ((q%9)*CELL_SZ) + CAGE_PAD,
@@ -577,33 +586,33 @@ namespace Sudoku
 	void Grid::generate(Difficulty d)
 	{
 		_invalid = false;
-		auto puz = PuzzleGen::gen_puzzle(diff);
-		auto& vec = puz.cells;
+		PuzzleGen::BuiltPuzzle const puz = wait_puzzle(diff);
 		for(u8 q = 0; q < 9*9; ++q)
 		{
 			Sudoku::Cell& c = cells[q];
-			auto [v,g] = vec[q];
+			u8 v = puz.solution(q);
 			c.clear();
 			c.solution = v;
-			if(g)
+			if(puz.given(q))
 			{
 				c.flags |= CFL_GIVEN;
 				c.val = v;
 			}
 			else c.flags &= ~CFL_GIVEN;
 		}
-		cages.swap(puz.cages);
+		num_cages = puz.num_cages;
+		memcpy(cage_of, puz.cage_of, sizeof(cage_of));
 		_active = true;
 	}
 	
 	u8 Grid::cage_sum(u8 indx, bool target) const
 	{
-		if(indx >= cages.size())
+		if(indx >= num_cages)
 			return 0;
-		auto& cage = cages[indx];
 		u8 sum = 0;
-		for(u8 q : cage)
-			sum += target ? cells[q].solution : cells[q].val;
+		for(u8 q = 0; q < CELL_COUNT; ++q)
+			if(cage_of[q] == indx)
+				sum += target ? cells[q].solution : cells[q].val;
 		return sum;
 	}
 	
@@ -785,6 +794,8 @@ namespace Sudoku
 	Grid::Grid(u16 X, u16 Y)
 		: InputObject(X,Y,9*CELL_SZ,9*CELL_SZ), _invalid(false), focus_cell(nullptr),
 		onExit(), selected()
-	{}
+	{
+		clear_cages();
+	}
 }
 
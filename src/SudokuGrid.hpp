@@ -44,7 +44,8 @@ namespace Sudoku
 		static const u8 CELL_COUNT = 9*9;
 		static int sel_style;
 		Cell cells[CELL_COUNT];
-		vector<set<u8>> cages;
+		u8 cage_of[CELL_COUNT]; //cage id of each cell, or NO_CAGE
+		u8 num_cages = 0;
 		std::function<void(Grid&)> onExit;
 		
 		Cell* get(u8 row, u8 col);
@@ -76,6 +77,7 @@ namespace Sudoku
 		Grid(u16 X, u16 Y);
 	private:
 		u8 cage_sum(u8 indx, bool target = true) const;
+		void clear_cages();
 		set<Cell*> selected;
 		Cell* focus_cell;
 		bool _invalid = false, _active = false;
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <deque>
+#include <set>
+#include <string>
+#include <optional>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <stdint.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+typedef int8_t i8;
+typedef int16_t i16;
+typedef int32_t i32;
+typedef int64_t i64;
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef unsigned int uint;
+using std::pair;
+using std::tuple;
+using std::string;
+using std::stringstream;
+using std::set;
+using std::map;
+using std::vector;
+using std::deque;
+using std::to_string;
+using std::optional;
+using std::nullopt;
+using std::shared_ptr;
+using std::make_shared;
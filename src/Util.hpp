@@ -68,16 +68,6 @@ T vbound(T v, T low, T high, bool& bounded)
 	return v;
 }
 
-template<typename T>
-T* rand(set<T>& s)
-{
-	if(s.empty()) return nullptr;
-	size_t indx = rand(s.size());
-	auto it = s.begin();
-	std::advance(it,indx);
-	return const_cast<T*>(&*it);
-}
-
 inline double vectorX(double len, double angle)
 {
 	return cos(angle)*len;
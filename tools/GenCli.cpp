@@ -0,0 +1,263 @@
+// Headless batch generator: builds puzzles on every core without the game,
+//     to fill puzzle banks and to measure generator throughput
+#include "../src/PuzzleGen.hpp"
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace PuzzleGen;
+
+enum OutFormat
+{
+	OUT_LINES, //81 characters per puzzle, '.' for blanks; killer cages are dropped
+	OUT_JSONL,
+	OUT_BANK,
+	OUT_NONE, //benchmark only
+	NUM_OUT
+};
+static char const* format_names[NUM_OUT] = {"lines","jsonl","bank","none"};
+static char const* diff_names[NUM_DIFF] = {"easy","normal","hard","killer"};
+
+static void usage(char const* prog)
+{
+	std::cerr << "Usage: " << prog << " [options]\n"
+		<< "  -n COUNT      puzzles per difficulty (default 100)\n"
+		<< "  -d LIST       comma-separated difficulties: easy,normal,hard,killer (default all)\n"
+		<< "  -j THREADS    worker threads (default one per hardware thread)\n"
+		<< "  -s SEED       base seed; the same seed always gives the same puzzles\n"
+		<< "  -f FORMAT     lines, jsonl, bank or none (default lines)\n"
+		<< "  -o FILE       output file (default stdout; required for bank)\n"
+		<< "  --solver NAME backtrack or dlx (default backtrack)\n"
+		<< "  -v            verbose logging\n";
+}
+
+static string puzzle_line(BuiltPuzzle const& puz, bool solution)
+{
+	string s(81, '.');
+	for(u8 q = 0; q < 81; ++q)
+		if(solution || puz.given(q))
+			s[q] = char('0' + puz.solution(q));
+	return s;
+}
+static string puzzle_json(BuiltPuzzle const& puz)
+{
+	LogicGrade grade = grade_puzzle(puz);
+	stringstream s;
+	s << format("{{\"difficulty\":\"{}\",\"seed\":{},\"puzzle\":\"{}\",\"solution\":\"{}\","
+		"\"technique\":\"{}\",\"steps\":{},\"score\":{}",
+		diff_names[puz.diff], puz.seed, puzzle_line(puz, false), puzzle_line(puz, true),
+		technique_name(grade.hardest), grade.steps, grade.score);
+	if(puz.num_cages)
+	{
+		s << ",\"cages\":[";
+		for(u8 c = 0; c < puz.num_cages; ++c)
+		{
+			s << (c ? "," : "") << "{\"sum\":" << int(puz.cage_sums[c]) << ",\"cells\":[";
+			bool first = true;
+			for(u8 q = 0; q < 81; ++q)
+			{
+				if(puz.cage_of[q] != c)
+					continue;
+				s << (first ? "" : ",") << int(q);
+				first = false;
+			}
+			s << "]}";
+		}
+		s << "]";
+	}
+	s << "}";
+	return s.str();
+}
+
+//Nearest-rank percentile of sorted samples
+static double percentile(vector<double> const& sorted, double p)
+{
+	if(sorted.empty())
+		return 0;
+	size_t rank = size_t(std::ceil(p * sorted.size()));
+	return sorted[rank ? rank-1 : 0];
+}
+
+int main(int argc, char** argv)
+{
+	u32 count = 100;
+	vector<Difficulty> diffs;
+	u16 threads = 0;
+	OutFormat out_fmt = OUT_LINES;
+	string out_file;
+	for(int q = 1; q < argc; ++q)
+	{
+		string arg = argv[q];
+		bool has_val = q+1 < argc;
+		if(arg == "-v")
+			verbose_log = true;
+		else if(!has_val)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		else if(arg == "-n")
+			count = std::stoul(argv[++q]);
+		else if(arg == "-j")
+			threads = std::stoul(argv[++q]);
+		else if(arg == "-s")
+			set_seed(std::stoull(argv[++q]));
+		else if(arg == "-o")
+			out_file = argv[++q];
+		else if(arg == "--solver")
+			set_solver(string(argv[++q]) == "dlx" ? SOLVER_DLX : SOLVER_BACKTRACK);
+		else if(arg == "-f")
+		{
+			string name = argv[++q];
+			u8 f = 0;
+			while(f < NUM_OUT && name != format_names[f])
+				++f;
+			if(f == NUM_OUT)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+			out_fmt = OutFormat(f);
+		}
+		else if(arg == "-d")
+		{
+			stringstream list(argv[++q]);
+			string name;
+			while(std::getline(list, name, ','))
+			{
+				u8 d = 0;
+				while(d < NUM_DIFF && name != diff_names[d])
+					++d;
+				if(d == NUM_DIFF)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				diffs.push_back(Difficulty(d));
+			}
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(diffs.empty())
+		for(u8 d = 0; d < NUM_DIFF; ++d)
+			diffs.push_back(Difficulty(d));
+	if(out_fmt == OUT_BANK && out_file.empty())
+	{
+		error("APSudoku-Gen", "-f bank needs an output file (-o)");
+		return 1;
+	}
+	set_threads(threads);
+	threads = get_threads();
+	u64 seed = get_seed();
+	
+	//Each puzzle's seed depends only on the base seed, its difficulty and its index,
+	//    so the output doesn't depend on the thread count or scheduling
+	struct Task
+	{
+		Difficulty diff;
+		u32 index;
+		BuiltPuzzle puz;
+		double secs;
+	};
+	vector<Task> tasks;
+	tasks.reserve(diffs.size() * count);
+	for(Difficulty d : diffs)
+		for(u32 q = 0; q < count; ++q)
+			tasks.push_back({d, q, {}, 0});
+	//Hand out the slowest difficulties first, so they don't straggle at the end
+	vector<size_t> order(tasks.size());
+	for(size_t q = 0; q < order.size(); ++q)
+		order[q] = q;
+	std::stable_sort(order.begin(), order.end(), [&tasks](size_t a, size_t b)
+		{
+			return tasks[a].diff > tasks[b].diff;
+		});
+	
+	std::cerr << format("Generating {} puzzles on {} threads (seed {})", tasks.size(), threads, seed) << std::endl;
+	std::atomic<size_t> next = 0;
+	std::atomic<bool> failed = false;
+	auto start = std::chrono::steady_clock::now();
+	auto work = [&]()
+		{
+			size_t q;
+			while(!failed && (q = next++) < order.size())
+			{
+				Task& t = tasks[order[q]];
+				auto t_start = std::chrono::steady_clock::now();
+				try
+				{
+					t.puz = build_puzzle(t.diff, worker_seed((u64(t.diff) << 32) | t.index));
+				}
+				catch(std::exception& e)
+				{
+					error("APSudoku-Gen", format("{} puzzle {}: {}", diff_names[t.diff], t.index, e.what()));
+					failed = true;
+				}
+				t.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+			}
+		};
+	vector<std::thread> pool;
+	for(u16 q = 0; q < threads; ++q)
+		pool.emplace_back(work);
+	for(std::thread& t : pool)
+		t.join();
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if(failed)
+		return 1;
+	
+	std::cerr << format("{} puzzles in {:.3f}s: {:.1f} puzzles/s", tasks.size(), wall, tasks.size() / wall) << std::endl;
+	for(Difficulty d : diffs)
+	{
+		vector<double> lat;
+		for(Task const& t : tasks)
+			if(t.diff == d)
+				lat.push_back(t.secs);
+		std::sort(lat.begin(), lat.end());
+		double total = 0;
+		for(double s : lat)
+			total += s;
+		std::cerr << format("{:>7}: {:.1f} puzzles/s per thread; latency mean {:.4f}s, p50 {:.4f}s, p95 {:.4f}s, p99 {:.4f}s, max {:.4f}s",
+			diff_names[d], lat.size() / total, total / lat.size(),
+			percentile(lat, 0.50), percentile(lat, 0.95), percentile(lat, 0.99), lat.back()) << std::endl;
+		if(verbose_log)
+			std::cerr << format("{:>7}  {}", "", get_stats(d).describe()) << std::endl;
+	}
+	
+	if(out_fmt == OUT_NONE)
+		return 0;
+	if(out_fmt == OUT_BANK)
+	{
+		BankWriter writer;
+		for(Task const& t : tasks)
+			writer.add(t.puz);
+		if(!writer.write(out_file))
+		{
+			error("APSudoku-Gen", format("Failed to write puzzle bank '{}'", out_file));
+			return 1;
+		}
+		std::cerr << format("Wrote puzzle bank '{}'", out_file) << std::endl;
+		return 0;
+	}
+	std::ofstream file;
+	if(!out_file.empty())
+	{
+		file.open(out_file, std::ios::trunc);
+		if(!file)
+		{
+			error("APSudoku-Gen", format("Failed to open '{}'", out_file));
+			return 1;
+		}
+	}
+	std::ostream& out = out_file.empty() ? std::cout : file;
+	for(Task const& t : tasks)
+		out << (out_fmt == OUT_JSONL ? puzzle_json(t.puz) : puzzle_line(t.puz, false)) << '\n';
+	out.flush();
+	return out ? 0 : 1;
+}